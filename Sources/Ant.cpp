@@ -1,20 +1,28 @@
 #include "pch.h"
 #include "Ant.h"
 #include "Engine/InstancedMeshObject.h"
+#include "Engine/InstanceBufferRing.h"
+#include "Engine/InstanceSlots.h"
+#include "Engine/JobSystem.h"
+#include "Engine/Frustum.h"
+#include "Engine/OcclusionBuffer.h"
+#include "Engine/Impostor.h"
+#include "Engine/VertexAnimation.h"
 #include "Engine/TriggerCollider.h"
 #include "KitchenObject.h"
 
 #include <assert.h>
 #include <Kore/Math/Random.h>
+#include <Kore/IO/FileReader.h>
 
 using namespace Kore;
 
 namespace {
-	Kore::VertexBuffer** vertexBuffers;
+	InstanceBufferRing* instances;
 	InstancedMeshObject* body;
 	InstancedMeshObject* leg;
 
-	const int maxAnts = 500;
+	const int maxAnts = Ant::maxAnts;
 	Ant ants[maxAnts];
 	float* scent;
 	const int scents = 100;
@@ -57,8 +65,272 @@ namespace {
 	}
 
 	int count = 0;
+
+	enum AntLod { AntLodFull, AntLodBody, AntLodSimpleBody, AntLodImpostor };
+
+	InstancedMeshObject* simpleBody;
+	Impostor* impostor;
+
+	// Past these distances legs are dropped and the body is replaced by a box
+	const float legsDistance = 6.0f;
+	const float simpleBodyDistance = 12.0f;
+	const float antRadius = 0.25f;
+
+	float antX[maxAnts];
+	float antY[maxAnts];
+	float antZ[maxAnts];
+	bool antVisible[maxAnts];
+
+	// Compacted per visible ant
+	AntLod lods[maxAnts];
+	float impostorAlphas[maxAnts];
+	int impostorViews[maxAnts];
+	vec3 positions[maxAnts];
+	// Ant::rotation turned to face forward
+	mat4 rotations[maxAnts];
+	float legRotations[maxAnts];
+	float phases[maxAnts];
+	int visibleCount = 0;
+
+
+	struct LegPlacement {
+		vec3 offset;
+		float swing;
+		bool mirrored;
+	};
+
+	// x = +-0.461/0.422/0.407, y = 0.461/0.414/0.381, z = 0.213/-0.01/-0.244 plus a common offset
+	const int legCount = 6;
+	const LegPlacement legPlacements[legCount] = {
+		{ vec3( 0.0461f + 0.044f, 0.0461f + 0.035f,  0.0213f + 0.023f),  1.0f, false },
+		{ vec3( 0.0422f + 0.044f, 0.0414f + 0.035f, -0.001f),           -1.0f, false },
+		{ vec3( 0.0407f + 0.044f, 0.0381f + 0.035f, -0.0244f - 0.028f),  1.0f, false },
+		{ vec3(-0.0461f - 0.044f, 0.0461f + 0.035f,  0.0213f + 0.023f), -1.0f, true },
+		{ vec3(-0.0422f - 0.044f, 0.0414f + 0.035f, -0.001f),            1.0f, true },
+		{ vec3(-0.0407f - 0.044f, 0.0381f + 0.035f, -0.0244f - 0.028f), -1.0f, true }
+	};
+
+	// Feelers sit at x = +-0.0486, y = 0.696, z = 0.818 of the unscaled body
+	const int feelerCount = 2;
+	const LegPlacement feelerPlacements[feelerCount] = {
+		{ vec3( 0.0486f * 0.2f, 0.696f * 0.2f, 0.818f * 0.2f), 0.0f, false },
+		{ vec3(-0.042f * 0.2f,  0.696f * 0.2f, 0.818f * 0.2f), 0.0f, true }
+	};
+
+	// The walk cycle baked for the nearest ants, body, legs and feelers in one draw
+	const int walkFrames = 16;
+	VertexAnimation* walk;
+	InstanceBufferRing* walkInstances;
+	// Dead ants don't move anymore, they keep their slot until they respawn
+	InstanceSlots* corpseSlots;
+	int corpseSlotOf[maxAnts];
+	int corpseCount = 0;
+	Program* walkProgram;
+	ConstantLocation walkPLocation;
+	ConstantLocation walkVLocation;
+	TextureUnit walkTex;
+	// Unlit, the atlas is already shaded
+	Program* impostorProgram;
+	ConstantLocation impostorPLocation;
+	ConstantLocation impostorVLocation;
+	TextureUnit impostorTex;
+
+	// The instance data of one draw. Regions are locked and unlocked on the main thread,
+	// jobs fill chunks of them in between.
+	struct InstanceFill {
+		VertexBuffer* buffer;
+		float* data;
+		// 36 floats, 37 with the walk phase
+		int size;
+		int count;
+		// Into the compacted arrays of the visible ants
+		int indices[maxAnts];
+		mat4 local;
+		// Legs compute their transforms from the ant's
+		const LegPlacement* placement;
+		// Impostors have no rotation and fade in
+		bool billboard;
+	};
+
+	struct FillChunk {
+		InstanceFill* fill;
+		int first;
+		int count;
+	};
+
+	const int fillChunkSize = 128;
+
+	// Full, simplified without legs and the box
+	InstanceFill bodyFills[3];
+	InstanceFill legFills[legCount];
+	InstanceFill walkFill;
+	InstanceFill* impostorFills;
+	std::vector<FillChunk> fillChunks;
+	vec3 legTranslations[legCount][maxAnts];
+	mat4 legRotationMatrices[legCount][maxAnts];
+
+	// legRotation swings between -pi/4 and pi/4, up and down again is one cycle
+	float legRotationAt(float phase) {
+		float t = phase < 0.5f ? phase * 2.0f : 2.0f - phase * 2.0f;
+		return -pi / 4.0f + t * pi / 2.0f;
+	}
+
+	float phaseOf(const AntState& ant) {
+		float t = Kore::max(0.0f, Kore::min(1.0f, (ant.legRotation + pi / 4.0f) / (pi / 2.0f)));
+		float phase = ant.legRotationUp ? t * 0.5f : 1.0f - t * 0.5f;
+		return phase >= 1.0f ? 0.0f : phase;
+	}
+
+	mat4 walkPose(int mesh, float phase) {
+		const float scale = 0.02f * 10.0f;
+		if (mesh == 0) return mat4::Scale(scale, scale, scale);
+		const LegPlacement& placement = mesh <= legCount ? legPlacements[mesh - 1] : feelerPlacements[mesh - 1 - legCount];
+		mat4 M = mat4::Translation(placement.offset.x(), placement.offset.y(), placement.offset.z()) * mat4::RotationX(placement.swing * legRotationAt(phase));
+		if (placement.mirrored) M *= mat4::RotationY(pi);
+		return M * mat4::Scale(scale, scale, scale);
+	}
+
+	void writeCorpse(const AntState& ant, int slot) {
+		mat4 M = mat4::Translation(ant.position.x(), ant.position.y(), ant.position.z()) * ant.rotation * mat4::RotationY(pi);
+		float* data = corpseSlots->write(slot);
+		setMatrix(data, 0, 0, 37, M);
+		setMatrix(data, 0, 16, 37, calculateN(M));
+		setVec4(data, 0, 32, 37, vec4(1, 1, 1, 1));
+		// legs straight down
+		data[36] = 0.25f;
+	}
+
+	void select(InstanceFill& fill, AntLod nearest, AntLod farthest) {
+		fill.count = 0;
+		for (int i = 0; i < visibleCount; ++i) {
+			if (lods[i] >= nearest && lods[i] <= farthest) fill.indices[fill.count++] = i;
+		}
+	}
+
+	void lock(InstanceFill& fill, InstanceBufferRing* ring, int size, mat4 local, const LegPlacement* placement = nullptr, bool billboard = false) {
+		fill.buffer = nullptr;
+		if (fill.count == 0) return;
+		fill.data = ring->lock();
+		fill.buffer = ring->current();
+		fill.size = size;
+		fill.local = local;
+		fill.placement = placement;
+		fill.billboard = billboard;
+		for (int first = 0; first < fill.count; first += fillChunkSize) {
+			FillChunk chunk;
+			chunk.fill = &fill;
+			chunk.first = first;
+			chunk.count = Kore::min(fillChunkSize, fill.count - first);
+			fillChunks.push_back(chunk);
+		}
+	}
+
+	void unlock(InstanceFill& fill) {
+		if (fill.buffer != nullptr) fill.buffer->unlock();
+	}
+
+	// Runs on any thread, chunks only write their own instances
+	void fillInstances(const FillChunk& chunk) {
+		const InstanceFill& fill = *chunk.fill;
+		float* data = &fill.data[chunk.first * fill.size];
+		const int* indices = &fill.indices[chunk.first];
+		if (fill.placement != nullptr) {
+			// Moving the offset out front keeps the rotation pure:
+			// T * R * offset * swing = Translation(position + R * offset) * (R * swing)
+			int l = (int)(fill.placement - legPlacements);
+			vec4 offset(fill.placement->offset.x(), fill.placement->offset.y(), fill.placement->offset.z(), 0);
+			vec3* chunkTranslations = &legTranslations[l][chunk.first];
+			mat4* chunkRotations = &legRotationMatrices[l][chunk.first];
+			for (int i = 0; i < chunk.count; ++i) {
+				int ant = indices[i];
+				vec4 rotated = rotations[ant] * offset;
+				chunkTranslations[i] = positions[ant] + vec3(rotated.x(), rotated.y(), rotated.z());
+				chunkRotations[i] = rotations[ant] * mat4::RotationX(fill.placement->swing * legRotations[ant]);
+			}
+			setTransforms(data, 0, fill.size, chunkTranslations, chunkRotations, nullptr, nullptr, chunk.count, fill.local);
+		}
+		else {
+			setTransforms(data, 0, fill.size, positions, fill.billboard ? nullptr : rotations, nullptr, indices, chunk.count, fill.local);
+		}
+		for (int i = 0; i < chunk.count; ++i) {
+			setVec4(data, i, 32, fill.size, vec4(1, 1, 1, fill.billboard ? impostorAlphas[indices[i]] : 1));
+			if (fill.size == 37) data[i * 37 + 36] = phases[indices[i]];
+		}
+	}
+
+	// Selects the instances of every draw, then fills them in parallel
+	void fillAll(mat4 view, JobSystem* jobs) {
+		const float scale = 0.02f;
+		fillChunks.clear();
+
+		bodyFills[0].count = 0;
+		if (!Ant::vertexAnimation) select(bodyFills[0], AntLodFull, AntLodFull);
+		lock(bodyFills[0], instances, 36, mat4::Scale(scale, scale, scale));
+		select(bodyFills[1], AntLodBody, AntLodBody);
+		lock(bodyFills[1], instances, 36, mat4::Scale(scale, scale, scale));
+		select(bodyFills[2], AntLodSimpleBody, AntLodSimpleBody);
+		lock(bodyFills[2], instances, 36, mat4::Scale(scale, scale, scale));
+
+		for (int l = 0; l < legCount; ++l) {
+			const LegPlacement& placement = legPlacements[l];
+			legFills[l].count = 0;
+			if (!Ant::vertexAnimation) select(legFills[l], AntLodFull, AntLodFull);
+			mat4 local = placement.mirrored ? mat4::RotationY(pi) * mat4::Scale(scale, scale, scale) : mat4::Scale(scale, scale, scale);
+			lock(legFills[l], instances, 36, local, &placement);
+		}
+
+		walkFill.count = 0;
+		if (Ant::vertexAnimation) select(walkFill, AntLodFull, AntLodFull);
+		lock(walkFill, walkInstances, 37, mat4::Identity());
+
+		mat4 billboard = view.Invert();
+		billboard.Set(0, 3, 0.0f);
+		billboard.Set(1, 3, 0.0f);
+		billboard.Set(2, 3, 0.0f);
+		for (int v = 0; v < impostor->views; ++v) {
+			InstanceFill& fill = impostorFills[v];
+			fill.count = 0;
+			for (int i = 0; i < visibleCount; ++i) {
+				if (impostorAlphas[i] > 0 && impostorViews[i] == v) fill.indices[fill.count++] = i;
+			}
+			lock(fill, instances, 36, billboard, nullptr, true);
+		}
+
+		jobs->parallelFor((int)fillChunks.size(), [](int c) {
+			fillInstances(fillChunks[c]);
+		});
+
+		for (int b = 0; b < 3; ++b) unlock(bodyFills[b]);
+		for (int l = 0; l < legCount; ++l) unlock(legFills[l]);
+		unlock(walkFill);
+		for (int v = 0; v < impostor->views; ++v) unlock(impostorFills[v]);
+		corpseSlots->upload();
+	}
+
+	void draw(CommandBuffer& commands, TextureUnit tex, InstancedMeshObject* mesh, IndexBuffer* indexBuffer, const InstanceFill& fill) {
+		if (fill.count == 0) return;
+		commands.setTexture(tex, mesh->image);
+		if (mesh->packed != nullptr) setPackedRange(commands, *mesh->packed, mesh->range);
+		VertexBuffer* vertexBuffers[2];
+		vertexBuffers[0] = mesh->vertexBuffers[0];
+		vertexBuffers[1] = fill.buffer;
+		commands.setVertexBuffers(vertexBuffers, 2);
+		commands.setIndexBuffer(indexBuffer);
+		commands.drawIndexedVerticesInstanced(fill.count);
+	}
 }
 
+int Ant::visibleAnts = 0;
+int Ant::culledAnts = 0;
+int Ant::occludedAnts = 0;
+int Ant::legsSkipped = 0;
+int Ant::impostors = 0;
+float Ant::impostorDistance = 16.0f;
+float Ant::impostorFade = 2.0f;
+bool Ant::vertexAnimation = true;
+int Ant::corpses = 0;
+int Ant::corpsesUploaded = 0;
+
 Ant::Ant() : mode(Floor) {
 	rotation = mat4::Identity();
 	forward = vec4(0, 0, -1, 0);
@@ -66,7 +338,7 @@ Ant::Ant() : mode(Floor) {
 	up = vec4(0, 1, 0, 0);
 }
 
-void Ant::init() {
+void Ant::init(const PackedLocations* packed) {
 	scent = new float[scents * scents * scents];
 	for (int i = 0; i < scents * scents * scents; ++i) {
 		scent[i] = Random::get(100) / 200.0f;
@@ -83,12 +355,82 @@ void Ant::init() {
 	structures[1]->add("N", Float4x4VertexData);
 	structures[1]->add("tint", Float4VertexData);
 
-	body = new InstancedMeshObject("Data/Meshes/ant_body.obj", "Data/Textures/tank_bottom.png", structures, 10, 10);
-	leg = new InstancedMeshObject("Data/Meshes/ant_leg.obj", "Data/Textures/tank_bottom.png", structures, 10, 10);
+	// The impostors stay with the float layout
+	VertexStructure** meshStructures = structures;
+	if (packed != nullptr) {
+		meshStructures = new VertexStructure*[2];
+		meshStructures[0] = new VertexStructure();
+		addPackedElements(*meshStructures[0]);
+		meshStructures[1] = structures[1];
+	}
+
+	body = new InstancedMeshObject("Data/Meshes/ant_body.obj", "Data/Textures/tank_bottom.png", meshStructures, 10, 10, packed);
+	// The body without legs is drawn from the first simplified level
+	body->buildLods();
+	leg = new InstancedMeshObject("Data/Meshes/ant_leg.obj", "Data/Textures/tank_bottom.png", meshStructures, 10, 10, packed);
+
+	simpleBody = new InstancedMeshObject(createBoundingBoxMesh(body->mesh), body->image, meshStructures, 10, 10, packed);
+
+	{
+		// Bake the standing ant as seen from eight directions, in the frame of Ant::rotation
+		const float scale = 0.02f * 10.0f;
+		Mesh* meshes[1 + legCount];
+		mat4 transforms[1 + legCount];
+		meshes[0] = body->mesh;
+		transforms[0] = mat4::RotationY(pi) * mat4::Scale(scale, scale, scale);
+		for (int l = 0; l < legCount; ++l) {
+			const LegPlacement& placement = legPlacements[l];
+			meshes[1 + l] = leg->mesh;
+			transforms[1 + l] = mat4::RotationY(pi) * mat4::Translation(placement.offset.x(), placement.offset.y(), placement.offset.z());
+			if (placement.mirrored) transforms[1 + l] *= mat4::RotationY(pi);
+			transforms[1 + l] *= mat4::Scale(scale, scale, scale);
+		}
+		impostor = new Impostor(meshes, transforms, 1 + legCount, body->image, structures);
+
+		FileReader vs("shader.vert");
+		FileReader fs("impostor.frag");
+		impostorProgram = new Program;
+		impostorProgram->setVertexShader(new Shader(vs.readAll(), vs.size(), VertexShader));
+		impostorProgram->setFragmentShader(new Shader(fs.readAll(), fs.size(), FragmentShader));
+		impostorProgram->link(structures, 2);
+		impostorTex = impostorProgram->getTextureUnit("tex");
+		impostorPLocation = impostorProgram->getConstantLocation("P");
+		impostorVLocation = impostorProgram->getConstantLocation("V");
+	}
+
+	// one region for the full body, the body without legs, the box, each of the six legs and each impostor view
+	instances = new InstanceBufferRing(*structures[1], maxAnts, 9 + impostor->views);
+	impostorFills = new InstanceFill[impostor->views];
 
-	vertexBuffers = new VertexBuffer*[2];
-	vertexBuffers[0] = body->vertexBuffers[0];
-	vertexBuffers[1] = new VertexBuffer(maxAnts, *structures[1], 1);
+	{
+		Mesh* feeler = loadObj("Data/Meshes/ant_feeler.obj");
+		Mesh* meshes[1 + legCount + feelerCount];
+		meshes[0] = body->mesh;
+		for (int l = 0; l < legCount; ++l) meshes[1 + l] = leg->mesh;
+		for (int f = 0; f < feelerCount; ++f) meshes[1 + legCount + f] = feeler;
+		walk = new VertexAnimation(meshes, 1 + legCount + feelerCount, walkFrames, walkPose, body->image);
+
+		VertexStructure** walkStructures = new VertexStructure*[2];
+		walkStructures[0] = VertexAnimation::structure();
+		walkStructures[1] = new VertexStructure();
+		walkStructures[1]->add("M", Float4x4VertexData);
+		walkStructures[1]->add("N", Float4x4VertexData);
+		walkStructures[1]->add("tint", Float4VertexData);
+		walkStructures[1]->add("phase", Float1VertexData);
+		walkInstances = new InstanceBufferRing(*walkStructures[1], maxAnts, 1);
+		corpseSlots = new InstanceSlots(*walkStructures[1], maxAnts);
+
+		FileReader vs("ant.vert");
+		FileReader fs("shader.frag");
+		walkProgram = new Program;
+		walkProgram->setVertexShader(new Shader(vs.readAll(), vs.size(), VertexShader));
+		walkProgram->setFragmentShader(new Shader(fs.readAll(), fs.size(), FragmentShader));
+		walkProgram->link(walkStructures, 2);
+		walkTex = walkProgram->getTextureUnit("tex");
+		walkPLocation = walkProgram->getConstantLocation("P");
+		walkVLocation = walkProgram->getConstantLocation("V");
+		walk->setLocations(walkProgram);
+	}
 
 	for (int i = 0; i < maxAnts; ++i) {
 		vec3 start(0, 1.5, 0);
@@ -97,6 +439,7 @@ void Ant::init() {
         
         ants[i].energy = 0;
         ants[i].dead = false;
+		corpseSlotOf[i] = -1;
 	}
 }
 
@@ -380,6 +723,7 @@ bool Ant::intersects(vec3 dir) {
 		return true;
 	}
 	for (unsigned oi = 0; kitchenObjects[oi] != nullptr; ++oi) {
+		if (!kitchenObjects[oi]->visible) continue;
 		if (intersectsWith(kitchenObjects[oi]->body, dir) || intersectsWith(kitchenObjects[oi]->door_closed, dir)) {
 			return true;
 		}
@@ -420,151 +764,124 @@ bool Ant::isDying() {
     return false;
 }
 
-void Ant::render(ConstantLocation vLocation, TextureUnit tex, mat4 view) {
-	int c = 0;
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
-		}
-		vertexBuffers[1]->unlock();
+void Ant::capture(AntState* states) {
+	for (int i = 0; i < maxAnts; ++i) {
+		states[i].position = ants[i].position;
+		states[i].rotation = ants[i].rotation;
+		states[i].legRotation = ants[i].legRotation;
+		states[i].legRotationUp = ants[i].legRotationUp;
+		states[i].dead = ants[i].dead;
 	}
+}
 
-	Graphics::setTexture(tex, body->image);
-	VertexBuffer* vertexBuffers[2];
-	vertexBuffers[0] = body->vertexBuffers[0];
-	vertexBuffers[1] = ::vertexBuffers[1];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*body->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
-
-	vec3 legsOffset = vec3(0.044f, 0.035f, 0.0f);
+void Ant::prepare(const AntState* states, mat4 view, mat4 projection, JobSystem* jobs, const OcclusionBuffer* occlusion) {
+	vec4 eye = view.Invert() * vec4(0, 0, 0, 1);
+	vec3 cameraPosition(eye.x(), eye.y(), eye.z());
 
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			//x = 0.461 , y = 0.461, z = 0.213
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Translation(0.0461f + legsOffset.x(), 0.0461f + legsOffset.y(), 0.0213f + 0.023f + legsOffset.z()) * mat4::RotationX(ants[i].legRotation) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
+	// Corpse slots follow the states, the simulation never touches instance data
+	for (int i = 0; i < maxAnts; ++i) {
+		if (states[i].dead && corpseSlotOf[i] < 0) {
+			corpseSlotOf[i] = corpseSlots->allocate();
+			if (corpseSlotOf[i] >= 0) {
+				writeCorpse(states[i], corpseSlotOf[i]);
+				++corpseCount;
+			}
 		}
-		vertexBuffers[1]->unlock();
-	}
-
-	vertexBuffers[0] = leg->vertexBuffers[0];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*leg->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
-
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		// x = 0.422 , y = 0.414, z = -0.01
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Translation(0.0422f + legsOffset.x(), 0.0414f + legsOffset.y(), -0.001f + legsOffset.z()) * mat4::RotationX(-ants[i].legRotation) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
+		else if (!states[i].dead && corpseSlotOf[i] >= 0) {
+			corpseSlots->free(corpseSlotOf[i]);
+			corpseSlotOf[i] = -1;
+			--corpseCount;
 		}
-		vertexBuffers[1]->unlock();
 	}
 
-	vertexBuffers[0] = leg->vertexBuffers[0];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*leg->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
-	
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		// x = 0.407, y = 0.381 , z = -0.244
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Translation(0.0407 + legsOffset.x(), 0.0381f + legsOffset.y(), -0.0244f - 0.028f + legsOffset.z()) * mat4::RotationX(ants[i].legRotation) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
-		}
-		vertexBuffers[1]->unlock();
+	for (int i = 0; i < maxAnts; ++i) {
+		antX[i] = states[i].position.x();
+		antY[i] = states[i].position.y();
+		antZ[i] = states[i].position.z();
 	}
+	Frustum frustum(projection * view);
+	frustum.cullSpheres(antX, antY, antZ, antRadius, maxAnts, antVisible);
+
+	visibleCount = 0;
+	culledAnts = 0;
+	occludedAnts = 0;
+	legsSkipped = 0;
+	impostors = 0;
+	for (int i = 0; i < maxAnts; ++i) {
+		if (states[i].dead) continue;
+		if (!antVisible[i]) {
+			++culledAnts;
+			continue;
+		}
+		if (occlusion != nullptr && !occlusion->isVisible(states[i].position, antRadius)) {
+			++occludedAnts;
+			continue;
+		}
+		float distance = (states[i].position - cameraPosition).squareLength();
+		if (distance > simpleBodyDistance * simpleBodyDistance) lods[visibleCount] = AntLodSimpleBody;
+		else if (distance > legsDistance * legsDistance) lods[visibleCount] = AntLodBody;
+		else lods[visibleCount] = AntLodFull;
+
+		// Impostors fade in over the last meters of the mesh range
+		const AntState& ant = states[i];
+		float fadeStart = Kore::max(0.0f, impostorDistance - impostorFade);
+		impostorAlphas[visibleCount] = 0;
+		if (distance >= impostorDistance * impostorDistance) {
+			lods[visibleCount] = AntLodImpostor;
+			impostorAlphas[visibleCount] = 1;
+		}
+		else if (distance > fadeStart * fadeStart) {
+			impostorAlphas[visibleCount] = (Kore::sqrt(distance) - fadeStart) / impostorFade;
+		}
+		// Impostors are counted on their own
+		if (lods[visibleCount] == AntLodBody || lods[visibleCount] == AntLodSimpleBody) ++legsSkipped;
+		if (impostorAlphas[visibleCount] > 0) {
+			vec3 toCamera = cameraPosition - ant.position;
+			vec4 local = ant.rotation.Transpose() * vec4(toCamera.x(), toCamera.y(), toCamera.z(), 0);
+			impostorViews[visibleCount] = impostor->viewFor(vec3(local.x(), local.y(), local.z()));
+			++impostors;
+		}
 
-	legsOffset.x() *= -1.0f;
+		positions[visibleCount] = ant.position;
+		rotations[visibleCount] = ant.rotation * mat4::RotationY(pi);
+		legRotations[visibleCount] = ant.legRotation;
+		phases[visibleCount] = phaseOf(ant);
+		++visibleCount;
+	}
+	visibleAnts = visibleCount;
 
-	vertexBuffers[0] = leg->vertexBuffers[0];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*leg->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
+	fillAll(view, jobs);
+}
 
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		// x = -0.461 , y = 0.461, z = 0.213
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Translation(-0.0461f + legsOffset.x(), 0.0461f + legsOffset.y(), 0.0213f + 0.023f + legsOffset.z()) * mat4::RotationX(-ants[i].legRotation) * mat4::RotationY(pi) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
-		}
-		vertexBuffers[1]->unlock();
+void Ant::render(CommandBuffer& commands, TextureUnit tex) {
+	draw(commands, tex, body, body->indexBuffer, bodyFills[0]);
+	// Without the legs the first simplified level is enough
+	draw(commands, tex, body, body->lods->indexBuffers[1], bodyFills[1]);
+	draw(commands, tex, simpleBody, simpleBody->indexBuffer, bodyFills[2]);
+	for (int l = 0; l < legCount; ++l) {
+		draw(commands, tex, leg, leg->indexBuffer, legFills[l]);
 	}
+}
 
-	vertexBuffers[0] = leg->vertexBuffers[0];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*leg->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
+void Ant::renderWalking(CommandBuffer& commands, mat4 view, mat4 projection) {
+	corpses = corpseCount;
+	corpsesUploaded = corpseSlots->uploaded;
+	if (walkFill.count == 0 && corpseSlots->count() == 0) return;
 
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		// x = -0.422 , y = 0.414, z = -0.01
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Translation(-0.0422f + legsOffset.x(), 0.0414f + legsOffset.y(), -0.001f + legsOffset.z()) * mat4::RotationX(ants[i].legRotation) * mat4::RotationY(pi) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
-		}
-		vertexBuffers[1]->unlock();
-	}
+	commands.setProgram(walkProgram);
+	commands.setMatrix(walkPLocation, projection);
+	commands.setMatrix(walkVLocation, view);
+	if (walkFill.count > 0) walk->render(commands, walkTex, walkFill.buffer, walkFill.count);
+	if (corpseSlots->count() > 0) walk->render(commands, walkTex, corpseSlots->vertexBuffer, corpseSlots->count());
+}
 
-	vertexBuffers[0] = leg->vertexBuffers[0];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*leg->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
-	
-	{
-		float* data = vertexBuffers[1]->lock();
-		c = 0;
-		// x = -0.407, y = 0.381 , z = -0.244
-		for (int i = 0; i < maxAnts; i++) {
-			const float scale = 0.02f;
-			mat4 M = mat4::Translation(ants[i].position.x(), ants[i].position.y(), ants[i].position.z()) * ants[i].rotation * mat4::RotationY(pi) * mat4::Translation(-0.0407 + legsOffset.x(), 0.0381f + legsOffset.y(), -0.0244f - 0.028f + legsOffset.z()) * mat4::RotationX(-ants[i].legRotation) * mat4::RotationY(pi) * mat4::Scale(scale, scale, scale);
-			setMatrix(data, i, 0, 36, M);
-			setMatrix(data, i, 16, 36, calculateN(M));
-			setVec4(data, i, 32, 36, vec4(1, 1, 1, 1));
-			c++;
-		}
-		vertexBuffers[1]->unlock();
+void Ant::renderImpostors(CommandBuffer& commands, mat4 view, mat4 projection) {
+	commands.setProgram(impostorProgram);
+	commands.setMatrix(impostorPLocation, projection);
+	commands.setMatrix(impostorVLocation, view);
+	commands.setRenderState(RenderState::DepthWrite, false);
+	for (int v = 0; v < impostor->views; ++v) {
+		if (impostorFills[v].count > 0) impostor->render(commands, impostorTex, v, impostorFills[v].buffer, impostorFills[v].count);
 	}
-
-	vertexBuffers[0] = leg->vertexBuffers[0];
-	Graphics::setVertexBuffers(vertexBuffers, 2);
-	Graphics::setIndexBuffer(*leg->indexBuffer);
-	Graphics::drawIndexedVerticesInstanced(c);
+	commands.setRenderState(RenderState::DepthWrite, true);
 }
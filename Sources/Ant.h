@@ -2,23 +2,67 @@
 
 #include <Kore/Math/Vector.h>
 #include <Kore/Math/Quaternion.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Engine/Graphics.h"
 
 #include "Engine/MeshObject.h"
 #include "Engine/TriggerCollider.h"
 
 class InstancedMeshObject;
+class JobSystem;
+class OcclusionBuffer;
 
 enum AntMode { Floor, LeftWall, RightWall, FrontWall, BackWall, Ceiling };
 
+// What drawing needs of an ant, copied out of the simulation every tick
+struct AntState {
+	Kore::vec3 position;
+	Kore::mat4 rotation;
+	float legRotation;
+	bool legRotationUp;
+	bool dead;
+};
+
 class Ant {
 public:
-	static void init();
+	static const int maxAnts = 500;
+
+	// With packed the bodies and legs use the packed vertex layout, drawn by a program taking its constants
+	static void init(const PackedLocations* packed = nullptr);
 	Ant();
 	void chooseScent(bool force);
 	static void moveEverybody(float deltaTime);
 	void move(float deltaTime);
-	static void render(Kore::ConstantLocation vLocation, Kore::TextureUnit tex, Kore::mat4 view);
+	// Copies maxAnts states, the simulation can go on while they are drawn
+	static void capture(AntState* states);
+	// Culling and level of detail, before any of the render calls of a frame.
+	// Also fills the instance data of all ant draws, spread over the jobs.
+	// Ants completely behind the occluders are skipped unless occlusion is nullptr.
+	static void prepare(const AntState* states, Kore::mat4 view, Kore::mat4 projection, JobSystem* jobs, const OcclusionBuffer* occlusion);
+	// Bodies and legs with the instanced program set, its packed variant when init got packed locations
+	static void render(CommandBuffer& commands, Kore::TextureUnit tex);
+	// Sets its own program
+	static void renderWalking(CommandBuffer& commands, Kore::mat4 view, Kore::mat4 projection);
+	// Transparent, after everything opaque. Sets its own unlit program.
+	static void renderImpostors(CommandBuffer& commands, Kore::mat4 view, Kore::mat4 projection);
+
+	// Statistics of the last frame
+	static int visibleAnts;
+	static int culledAnts;
+	static int occludedAnts;
+	// Drawn as a mesh without legs, impostors not included
+	static int legsSkipped;
+	static int impostors;
+
+	// Ants further away are drawn as pre-rendered sprites, fading in over impostorFade
+	static float impostorDistance;
+	static float impostorFade;
+
+	// Nearby ants are drawn in one call with the walk cycle baked into a texture
+	static bool vertexAnimation;
+
+	// Dead ants, and how many of them had to be uploaded again last frame
+	static int corpses;
+	static int corpsesUploaded;
 
 	static void morePizze(Kore::vec3 position);
 	static void lessPizza(Kore::vec3 position);
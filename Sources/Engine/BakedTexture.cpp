@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "BakedTexture.h"
+
+#include <Kore/Log.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	const int version = 1;
+
+	// Followed by the levels, largest first, each width * height RGBA texels without padding
+	struct Header {
+		char magic[4];
+		int version;
+		int width;
+		int height;
+		int levels;
+	};
+
+	// Read only view of a whole file, empty when it can not be opened
+	class MappedFile {
+	public:
+		MappedFile(const char* filename) : data(nullptr), size(0) {
+#ifdef _WIN32
+			mapping = nullptr;
+			file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return;
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr) return;
+			data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data != nullptr) size = (size_t)fileSize.QuadPart;
+#else
+			file = open(filename, O_RDONLY);
+			if (file < 0) return;
+			struct stat info;
+			if (fstat(file, &info) != 0 || info.st_size == 0) return;
+			void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (mapped == MAP_FAILED) return;
+			data = (const unsigned char*)mapped;
+			size = info.st_size;
+#endif
+		}
+
+		~MappedFile() {
+#ifdef _WIN32
+			if (data != nullptr) UnmapViewOfFile(data);
+			if (mapping != nullptr) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+			if (data != nullptr) munmap((void*)data, size);
+			if (file >= 0) close(file);
+#endif
+		}
+
+		const unsigned char* data;
+		size_t size;
+
+	private:
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#else
+		int file;
+#endif
+	};
+
+	// Data/Textures/sand.png -> Data/Textures/sand.ktex
+	void bakedName(const char* filename, char* baked, int size) {
+		strncpy(baked, filename, size - 6);
+		baked[size - 6] = 0;
+		char* dot = strrchr(baked, '.');
+		if (dot != nullptr && strchr(dot, '/') == nullptr) *dot = 0;
+		strcat(baked, ".ktex");
+	}
+
+	int levelSize(int size, int level) {
+		return Kore::max(1, size >> level);
+	}
+
+	// Copies tightly packed RGBA texels into the texture and, for readable ones, into the image data
+	void fill(Texture* texture, const unsigned char* texels, bool readable) {
+		int width = texture->width;
+		int height = texture->height;
+		unsigned char* pixels = texture->lock();
+		int stride = texture->stride();
+		for (int y = 0; y < height; ++y) {
+#ifdef OPENGL
+			memcpy(&pixels[y * stride], &texels[y * width * 4], width * 4);
+#else
+			for (int x = 0; x < width; ++x) {
+				const unsigned char* texel = &texels[(y * width + x) * 4];
+				unsigned char* pixel = &pixels[y * stride + x * 4];
+				pixel[0] = texel[2];
+				pixel[1] = texel[1];
+				pixel[2] = texel[0];
+				pixel[3] = texel[3];
+			}
+#endif
+		}
+		texture->unlock();
+		// CPU side copy for Image::at, unless the lock already handed out that copy
+		if (readable && texture->data != nullptr && texture->data != pixels) {
+			memcpy(texture->data, texels, width * height * 4);
+		}
+	}
+
+	// The header when the file is complete, nullptr otherwise
+	const Header* check(const MappedFile& file, const char* baked) {
+		if (file.data == nullptr) return nullptr;
+
+		const Header* header = (const Header*)file.data;
+		if (file.size < sizeof(Header) || memcmp(header->magic, "KTEX", 4) != 0 || header->version != version) {
+			log(Warning, "%s is no baked texture of version %i", baked, version);
+			return nullptr;
+		}
+		size_t expected = sizeof(Header);
+		for (int l = 0; l < header->levels; ++l) {
+			expected += (size_t)levelSize(header->width, l) * levelSize(header->height, l) * 4;
+		}
+		if (file.size < expected) {
+			log(Warning, "%s is cut off", baked);
+			return nullptr;
+		}
+		return header;
+	}
+
+	// Box filter, an odd last row or column is folded into the one before
+	void downsample(const unsigned char* from, int width, int height, unsigned char* to) {
+		int toWidth = Kore::max(1, width / 2);
+		int toHeight = Kore::max(1, height / 2);
+		for (int y = 0; y < toHeight; ++y) {
+			for (int x = 0; x < toWidth; ++x) {
+				int x0 = Kore::min(x * 2, width - 1);
+				int x1 = Kore::min(x * 2 + 1, width - 1);
+				int y0 = Kore::min(y * 2, height - 1);
+				int y1 = Kore::min(y * 2 + 1, height - 1);
+				for (int c = 0; c < 4; ++c) {
+					int sum = from[(y0 * width + x0) * 4 + c] + from[(y0 * width + x1) * 4 + c] + from[(y1 * width + x0) * 4 + c] + from[(y1 * width + x1) * 4 + c];
+					to[(y * toWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+Texture* loadBakedTexture(const char* filename, bool readable) {
+	char baked[256];
+	bakedName(filename, baked, sizeof(baked));
+	MappedFile file(baked);
+	const Header* header = check(file, baked);
+	if (header == nullptr) return nullptr;
+
+	const unsigned char* texels = file.data + sizeof(Header);
+	Texture* texture = createTexture(texels, header->width, header->height, readable);
+	texels += header->width * header->height * 4;
+	for (int l = 1; l < header->levels; ++l) {
+		int width = levelSize(header->width, l);
+		int height = levelSize(header->height, l);
+		Texture* mipmap = createTexture(texels, width, height, false);
+		texture->setMipmap(mipmap, l);
+		delete mipmap;
+		texels += width * height * 4;
+	}
+	return texture;
+}
+
+bool isBaked(const char* filename) {
+	char baked[256];
+	bakedName(filename, baked, sizeof(baked));
+	MappedFile file(baked);
+	return check(file, baked) != nullptr;
+}
+
+Texture* createTexture(const unsigned char* texels, int width, int height, bool readable) {
+	Texture* texture = new Texture(width, height, Image::RGBA32, readable);
+	fill(texture, texels, readable);
+	return texture;
+}
+
+bool bakeTexture(const char* filename, const Image& image) {
+	if (image.format != Image::RGBA32 || image.data == nullptr) {
+		log(Warning, "Can not bake %s, only RGBA images are supported", filename);
+		return false;
+	}
+
+	char baked[256];
+	bakedName(filename, baked, sizeof(baked));
+	FILE* file = fopen(baked, "wb");
+	if (file == nullptr) {
+		log(Warning, "Can not write %s", baked);
+		return false;
+	}
+
+	Header header;
+	memcpy(header.magic, "KTEX", 4);
+	header.version = version;
+	header.width = image.width;
+	header.height = image.height;
+	header.levels = 1;
+	while (levelSize(image.width, header.levels - 1) > 1 || levelSize(image.height, header.levels - 1) > 1) ++header.levels;
+	fwrite(&header, sizeof(header), 1, file);
+
+	std::vector<unsigned char> level(image.data, image.data + image.width * image.height * 4);
+	std::vector<unsigned char> next;
+	for (int l = 0; l < header.levels; ++l) {
+		int width = levelSize(image.width, l);
+		int height = levelSize(image.height, l);
+		fwrite(level.data(), 1, level.size(), file);
+		if (l + 1 == header.levels) break;
+		next.resize(levelSize(image.width, l + 1) * levelSize(image.height, l + 1) * 4);
+		downsample(level.data(), width, height, next.data());
+		level.swap(next);
+	}
+	bool failed = ferror(file) != 0;
+	fclose(file);
+	if (failed) {
+		log(Warning, "Writing %s failed", baked);
+		return false;
+	}
+	log(Info, "Baked %s, %i x %i with %i levels", baked, header.width, header.height, header.levels);
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Graphics.h"
+
+// Textures can be baked into a .ktex file next to their png: a small header and the
+// RGBA pixels of the whole mip chain. Baked files are mapped into memory and
+// uploaded as they are, which skips decoding the png at startup.
+// See TextureLoader.h for loading textures either way.
+
+// nullptr when there is no usable baked file for filename
+Kore::Texture* loadBakedTexture(const char* filename, bool readable);
+
+// Whether filename has a baked file, only reads its header
+bool isBaked(const char* filename);
+
+// Writes filename's baked file from the decoded png, false when that failed
+bool bakeTexture(const char* filename, const Kore::Image& image);
+
+// From tightly packed RGBA texels, in the order Image keeps them
+Kore::Texture* createTexture(const unsigned char* texels, int width, int height, bool readable);
@@ -0,0 +1,61 @@
+#include "pch.h"
+#include "Benchmark.h"
+
+#include <Kore/Log.h>
+#include <Kore/Math/Matrix.h>
+#include <Kore/System.h>
+
+#include "Rendering.h"
+#include "SimpleGraphics.h"
+
+using namespace Kore;
+
+namespace {
+	const int instanceCount = 10000;
+	const int repetitions = 100;
+	const int instanceSize = 36;
+
+	void benchmarkTransforms() {
+		vec3* translations = new vec3[instanceCount];
+		mat4* rotations = new mat4[instanceCount];
+		for (int i = 0; i < instanceCount; ++i) {
+			translations[i] = vec3(i * 0.01f, 0, -i * 0.02f);
+			rotations[i] = mat4::RotationY(i * 0.1f) * mat4::RotationX(i * 0.03f);
+		}
+		const float scale = 0.02f;
+		mat4 local = mat4::Scale(scale, scale, scale);
+		float* data = new float[instanceCount * instanceSize];
+
+		// What every instance did before setTransforms
+		double start = System::time();
+		for (int r = 0; r < repetitions; ++r) {
+			for (int i = 0; i < instanceCount; ++i) {
+				mat4 M = mat4::Translation(translations[i].x(), translations[i].y(), translations[i].z()) * rotations[i] * local;
+				setMatrix(data, i, 0, instanceSize, M);
+				setMatrix(data, i, 16, instanceSize, calculateN(M));
+			}
+		}
+		double perInstance = System::time() - start;
+		// Read back so neither loop can be left out
+		float check = data[(instanceCount - 1) * instanceSize + 12];
+
+		start = System::time();
+		for (int r = 0; r < repetitions; ++r) {
+			setTransforms(data, 0, instanceSize, translations, rotations, nullptr, nullptr, instanceCount, local);
+		}
+		double batched = System::time() - start;
+		check += data[(instanceCount - 1) * instanceSize + 12];
+
+		log(Info, "Instance transforms of %i instances: setMatrix per instance %f ms, setTransforms %f ms (checksum %f)",
+			instanceCount, perInstance * 1000.0 / repetitions, batched * 1000.0 / repetitions, check);
+
+		delete[] data;
+		delete[] rotations;
+		delete[] translations;
+	}
+}
+
+bool runBenchmarks() {
+	benchmarkTransforms();
+	return benchmarkPixelRows();
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Times the fast paths against the code they replaced, for the headless build's --benchmark.
+// Returns false when a fast path gave other results than the code it replaced.
+bool runBenchmarks();
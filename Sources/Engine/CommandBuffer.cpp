@@ -0,0 +1,218 @@
+#include "pch.h"
+#include "CommandBuffer.h"
+
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	int lockedBytes = 0;
+}
+
+CommandBuffer::CommandBuffer() : program(nullptr), texture(nullptr), indexBuffer(nullptr) {
+	memset(&stats, 0, sizeof(stats));
+	memset(&recording, 0, sizeof(recording));
+}
+
+void CommandBuffer::countLock(int bytes) {
+	lockedBytes += bytes;
+}
+
+void CommandBuffer::setProgram(Program* program) {
+	if (program != this->program) ++recording.programSwitches;
+	this->program = program;
+	commands.push_back(SetProgram);
+	programs.push_back(program);
+}
+
+void CommandBuffer::setTexture(TextureUnit unit, Texture* texture) {
+	if (texture != this->texture) ++recording.textureSwitches;
+	this->texture = texture;
+	commands.push_back(SetTexture);
+	units.push_back(unit);
+	textures.push_back(texture);
+}
+
+void CommandBuffer::setTextureAddressing(TextureUnit unit, TexDir dir, TextureAddressing addressing) {
+	commands.push_back(SetTextureAddressing);
+	units.push_back(unit);
+	ints.push_back(dir);
+	ints.push_back(addressing);
+}
+
+void CommandBuffer::setTextureMinificationFilter(TextureUnit unit, TextureFilter filter) {
+	commands.push_back(SetTextureMinificationFilter);
+	units.push_back(unit);
+	ints.push_back(filter);
+}
+
+void CommandBuffer::setTextureMagnificationFilter(TextureUnit unit, TextureFilter filter) {
+	commands.push_back(SetTextureMagnificationFilter);
+	units.push_back(unit);
+	ints.push_back(filter);
+}
+
+void CommandBuffer::setMatrix(ConstantLocation location, const mat4& value) {
+	commands.push_back(SetMatrix);
+	locations.push_back(location);
+	matrices.push_back(value);
+}
+
+void CommandBuffer::setFloat(ConstantLocation location, float value) {
+	commands.push_back(SetFloat);
+	locations.push_back(location);
+	floats.push_back(value);
+}
+
+void CommandBuffer::setFloat3(ConstantLocation location, float value1, float value2, float value3) {
+	commands.push_back(SetFloat3);
+	locations.push_back(location);
+	floats.push_back(value1);
+	floats.push_back(value2);
+	floats.push_back(value3);
+}
+
+void CommandBuffer::setFloat4(ConstantLocation location, float value1, float value2, float value3, float value4) {
+	commands.push_back(SetFloat4);
+	locations.push_back(location);
+	floats.push_back(value1);
+	floats.push_back(value2);
+	floats.push_back(value3);
+	floats.push_back(value4);
+}
+
+void CommandBuffer::setRenderState(RenderState state, bool on) {
+	commands.push_back(SetRenderState);
+	ints.push_back(state);
+	ints.push_back(on ? 1 : 0);
+}
+
+void CommandBuffer::setVertexBuffer(VertexBuffer* vertexBuffer) {
+	setVertexBuffers(&vertexBuffer, 1);
+}
+
+void CommandBuffer::setVertexBuffers(VertexBuffer** vertexBuffers, int count) {
+	commands.push_back(SetVertexBuffers);
+	ints.push_back(count);
+	for (int i = 0; i < count; ++i) {
+		this->vertexBuffers.push_back(vertexBuffers[i]);
+	}
+}
+
+void CommandBuffer::setIndexBuffer(IndexBuffer* indexBuffer) {
+	this->indexBuffer = indexBuffer;
+	commands.push_back(SetIndexBuffer);
+	indexBuffers.push_back(indexBuffer);
+}
+
+void CommandBuffer::draw(int indices, int instances) {
+	++recording.drawCalls;
+	recording.instances += instances;
+	recording.triangles += indices / 3 * instances;
+}
+
+void CommandBuffer::drawIndexedVertices() {
+	draw(indexBuffer->count(), 1);
+	commands.push_back(DrawIndexedVertices);
+	// A count of -1 draws the whole index buffer
+	ints.push_back(0);
+	ints.push_back(-1);
+}
+
+void CommandBuffer::drawIndexedVertices(int start, int count) {
+	draw(count, 1);
+	commands.push_back(DrawIndexedVertices);
+	ints.push_back(start);
+	ints.push_back(count);
+}
+
+void CommandBuffer::drawIndexedVerticesInstanced(int instances) {
+	draw(indexBuffer->count(), instances);
+	commands.push_back(DrawIndexedVerticesInstanced);
+	ints.push_back(instances);
+}
+
+void CommandBuffer::execute() {
+	int nextInt = 0;
+	int nextFloat = 0;
+	int nextMatrix = 0;
+	int nextLocation = 0;
+	int nextUnit = 0;
+	int nextTexture = 0;
+	int nextProgram = 0;
+	int nextVertexBuffer = 0;
+	int nextIndexBuffer = 0;
+	for (unsigned c = 0; c < commands.size(); ++c) {
+		switch (commands[c]) {
+		case SetProgram:
+			programs[nextProgram++]->set();
+			break;
+		case SetTexture:
+			Graphics::setTexture(units[nextUnit++], textures[nextTexture++]);
+			break;
+		case SetTextureAddressing:
+			Graphics::setTextureAddressing(units[nextUnit++], (TexDir)ints[nextInt], (TextureAddressing)ints[nextInt + 1]);
+			nextInt += 2;
+			break;
+		case SetTextureMinificationFilter:
+			Graphics::setTextureMinificationFilter(units[nextUnit++], (TextureFilter)ints[nextInt++]);
+			break;
+		case SetTextureMagnificationFilter:
+			Graphics::setTextureMagnificationFilter(units[nextUnit++], (TextureFilter)ints[nextInt++]);
+			break;
+		case SetMatrix:
+			Graphics::setMatrix(locations[nextLocation++], matrices[nextMatrix++]);
+			break;
+		case SetFloat:
+			Graphics::setFloat(locations[nextLocation++], floats[nextFloat++]);
+			break;
+		case SetFloat3:
+			Graphics::setFloat3(locations[nextLocation++], floats[nextFloat], floats[nextFloat + 1], floats[nextFloat + 2]);
+			nextFloat += 3;
+			break;
+		case SetFloat4:
+			Graphics::setFloat4(locations[nextLocation++], floats[nextFloat], floats[nextFloat + 1], floats[nextFloat + 2], floats[nextFloat + 3]);
+			nextFloat += 4;
+			break;
+		case SetRenderState:
+			Graphics::setRenderState((RenderState)ints[nextInt], ints[nextInt + 1] != 0);
+			nextInt += 2;
+			break;
+		case SetVertexBuffers: {
+			int count = ints[nextInt++];
+			if (count == 1) Graphics::setVertexBuffer(*vertexBuffers[nextVertexBuffer]);
+			else Graphics::setVertexBuffers(&vertexBuffers[nextVertexBuffer], count);
+			nextVertexBuffer += count;
+			break;
+		}
+		case SetIndexBuffer:
+			Graphics::setIndexBuffer(*indexBuffers[nextIndexBuffer++]);
+			break;
+		case DrawIndexedVertices:
+			if (ints[nextInt + 1] < 0) Graphics::drawIndexedVertices();
+			else Graphics::drawIndexedVertices(ints[nextInt], ints[nextInt + 1]);
+			nextInt += 2;
+			break;
+		case DrawIndexedVerticesInstanced:
+			Graphics::drawIndexedVerticesInstanced(ints[nextInt++]);
+			break;
+		}
+	}
+
+	stats = recording;
+	stats.commands = (int)commands.size();
+	stats.bytesLocked = lockedBytes;
+	memset(&recording, 0, sizeof(recording));
+	lockedBytes = 0;
+
+	commands.clear();
+	ints.clear();
+	floats.clear();
+	matrices.clear();
+	locations.clear();
+	units.clear();
+	textures.clear();
+	programs.clear();
+	vertexBuffers.clear();
+	indexBuffers.clear();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+#include "Graphics.h"
+
+// Records draw submissions in the order of the calls and replays them to Kore in
+// execute(). Commands are one byte each, their arguments go into typed arrays that
+// execute() reads back in the same order. Buffers are locked while recording, only
+// the state changes and draws are deferred.
+class CommandBuffer {
+public:
+	CommandBuffer();
+
+	void setProgram(Kore::Program* program);
+	void setTexture(Kore::TextureUnit unit, Kore::Texture* texture);
+	void setTextureAddressing(Kore::TextureUnit unit, Kore::TexDir dir, Kore::TextureAddressing addressing);
+	void setTextureMinificationFilter(Kore::TextureUnit unit, Kore::TextureFilter filter);
+	void setTextureMagnificationFilter(Kore::TextureUnit unit, Kore::TextureFilter filter);
+	void setMatrix(Kore::ConstantLocation location, const Kore::mat4& value);
+	void setFloat(Kore::ConstantLocation location, float value);
+	void setFloat3(Kore::ConstantLocation location, float value1, float value2, float value3);
+	void setFloat4(Kore::ConstantLocation location, float value1, float value2, float value3, float value4);
+	void setRenderState(Kore::RenderState state, bool on);
+	void setVertexBuffer(Kore::VertexBuffer* vertexBuffer);
+	// The pointers are copied, the array can change right after
+	void setVertexBuffers(Kore::VertexBuffer** vertexBuffers, int count);
+	void setIndexBuffer(Kore::IndexBuffer* indexBuffer);
+	void drawIndexedVertices();
+	void drawIndexedVertices(int start, int count);
+	void drawIndexedVerticesInstanced(int instances);
+
+	// Replays everything recorded since the last execute() and starts over
+	void execute();
+
+	// Called wherever instance or vertex data is locked during a frame
+	static void countLock(int bytes);
+
+	struct Stats {
+		int commands;
+		int drawCalls;
+		int instances;
+		int triangles;
+		int bytesLocked;
+		int textureSwitches;
+		int programSwitches;
+	};
+
+	// Of the last execute()
+	Stats stats;
+
+private:
+	enum Command : unsigned char {
+		SetProgram,
+		SetTexture,
+		SetTextureAddressing,
+		SetTextureMinificationFilter,
+		SetTextureMagnificationFilter,
+		SetMatrix,
+		SetFloat,
+		SetFloat3,
+		SetFloat4,
+		SetRenderState,
+		SetVertexBuffers,
+		SetIndexBuffer,
+		DrawIndexedVertices,
+		DrawIndexedVerticesInstanced
+	};
+
+	void draw(int indices, int instances);
+
+	std::vector<Command> commands;
+	std::vector<int> ints;
+	std::vector<float> floats;
+	std::vector<Kore::mat4> matrices;
+	std::vector<Kore::ConstantLocation> locations;
+	std::vector<Kore::TextureUnit> units;
+	std::vector<Kore::Texture*> textures;
+	std::vector<Kore::Program*> programs;
+	std::vector<Kore::VertexBuffer*> vertexBuffers;
+	std::vector<Kore::IndexBuffer*> indexBuffers;
+
+	// While recording, for the statistics
+	Stats recording;
+	Kore::Program* program;
+	Kore::Texture* texture;
+	Kore::IndexBuffer* indexBuffer;
+};
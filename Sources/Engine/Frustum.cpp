@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "Frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+using namespace Kore;
+
+Frustum::Frustum(mat4 PV) {
+	// Gribb/Hartmann: the planes are sums and differences of the matrix rows
+	for (int i = 0; i < 3; ++i) {
+		for (int side = 0; side < 2; ++side) {
+			float sign = side == 0 ? 1.0f : -1.0f;
+			vec4& plane = planes[i * 2 + side];
+			for (int col = 0; col < 4; ++col) {
+				plane[col] = PV.get(3, col) + sign * PV.get(i, col);
+			}
+			float length = vec3(plane.x(), plane.y(), plane.z()).getLength();
+			plane *= 1.0f / length;
+		}
+	}
+}
+
+bool Frustum::isVisible(vec3 center, float radius) const {
+	for (int i = 0; i < 6; ++i) {
+		if (planes[i].x() * center.x() + planes[i].y() * center.y() + planes[i].z() * center.z() + planes[i].w() < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::isVisible(vec3 min, vec3 max) const {
+	// Only the corner furthest along the plane's normal has to be inside
+	for (int i = 0; i < 6; ++i) {
+		float x = planes[i].x() >= 0 ? max.x() : min.x();
+		float y = planes[i].y() >= 0 ? max.y() : min.y();
+		float z = planes[i].z() >= 0 ? max.z() : min.z();
+		if (planes[i].x() * x + planes[i].y() * y + planes[i].z() * z + planes[i].w() < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void Frustum::cullSpheres(const float* x, const float* y, const float* z, float radius, int count, bool* visible) const {
+	int i = 0;
+#ifdef FRUSTUM_SSE
+	__m128 r = _mm_set1_ps(-radius);
+	for (; i + 4 <= count; i += 4) {
+		__m128 px = _mm_loadu_ps(&x[i]);
+		__m128 py = _mm_loadu_ps(&y[i]);
+		__m128 pz = _mm_loadu_ps(&z[i]);
+		__m128 inside = _mm_cmpeq_ps(r, r);
+		for (int p = 0; p < 6; ++p) {
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(planes[p].x())), _mm_mul_ps(py, _mm_set1_ps(planes[p].y()))),
+				_mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(planes[p].z())), _mm_set1_ps(planes[p].w())));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, r));
+		}
+		int mask = _mm_movemask_ps(inside);
+		visible[i + 0] = (mask & 1) != 0;
+		visible[i + 1] = (mask & 2) != 0;
+		visible[i + 2] = (mask & 4) != 0;
+		visible[i + 3] = (mask & 8) != 0;
+	}
+#endif
+	for (; i < count; ++i) {
+		visible[i] = isVisible(vec3(x[i], y[i], z[i]), radius);
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Kore/Math/Matrix.h>
+
+// The six clip planes of a projection * view matrix, normals point inwards
+class Frustum {
+public:
+	Frustum(Kore::mat4 PV);
+
+	bool isVisible(Kore::vec3 center, float radius) const;
+	// Axis aligned box
+	bool isVisible(Kore::vec3 min, Kore::vec3 max) const;
+
+	// Tests count spheres of equal radius given as separate coordinate arrays
+	// four at a time, visible[i] is set to whether sphere i touches the frustum
+	void cullSpheres(const float* x, const float* y, const float* z, float radius, int count, bool* visible) const;
+
+	Kore::vec4 planes[6];
+};
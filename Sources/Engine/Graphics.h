@@ -0,0 +1,9 @@
+#pragma once
+
+// Include this instead of Kore's graphics header, NULL_GRAPHICS swaps in NullGraphics.h
+#ifdef NULL_GRAPHICS
+#include "NullGraphics.h"
+#else
+#include <Kore/Graphics/Graphics.h>
+#include <Kore/Graphics/Shader.h>
+#endif
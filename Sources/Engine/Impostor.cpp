@@ -0,0 +1,144 @@
+#include "pch.h"
+#include "Impostor.h"
+#include "CommandBuffer.h"
+
+#include <Kore/Math/Core.h>
+#include <Kore/Graphics/Image.h>
+
+#include "Rendering.h"
+
+using namespace Kore;
+
+namespace {
+	vec3 transformPoint(const mat4& m, const float* p) {
+		vec4 v = m * vec4(p[0], p[1], p[2], 1);
+		return vec3(v.x(), v.y(), v.z());
+	}
+
+	vec3 transformNormal(const mat4& m, const float* n) {
+		vec4 v = m * vec4(n[0], n[1], n[2], 0);
+		vec3 result(v.x(), v.y(), v.z());
+		float length = result.getLength();
+		return length > 0 ? result * (1.0f / length) : vec3(0, 1, 0);
+	}
+
+	float edge(float ax, float ay, float bx, float by, float px, float py) {
+		return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+	}
+}
+
+Impostor::Impostor(Mesh** meshes, mat4* transforms, int meshCount, Image* colors, VertexStructure** structures, int views, int viewSize, float elevation) : views(views) {
+	radius = 0;
+	for (int m = 0; m < meshCount; ++m) {
+		for (int i = 0; i < meshes[m]->numVertices; ++i) {
+			radius = Kore::max(radius, transformPoint(transforms[m], &meshes[m]->vertices[i * 8]).getLength());
+		}
+	}
+
+	int atlasWidth = views * viewSize;
+	atlas = new Texture(atlasWidth, viewSize, Image::RGBA32, false);
+	int* pixels = (int*)atlas->lock();
+	for (int i = 0; i < atlas->texWidth * viewSize; ++i) pixels[i] = 0;
+	float* depth = new float[viewSize * viewSize];
+
+	vec3 light = vec3(0.3f, 1.0f, 0.5f);
+	light = light.normalize();
+
+	for (int view = 0; view < views; ++view) {
+		// Camera on a circle around the object, looking at its center
+		float angle = 2.0f * pi * view / views;
+		vec3 toCamera(Kore::sin(angle) * Kore::cos(elevation), Kore::sin(elevation), Kore::cos(angle) * Kore::cos(elevation));
+		vec3 right = vec3(0, 1, 0).cross(toCamera);
+		right = right.normalize();
+		vec3 up = toCamera.cross(right);
+
+		for (int i = 0; i < viewSize * viewSize; ++i) depth[i] = -radius;
+
+		for (int m = 0; m < meshCount; ++m) {
+			Mesh* mesh = meshes[m];
+			for (int f = 0; f < mesh->numFaces; ++f) {
+				float sx[3], sy[3], sz[3];
+				float u = 0, v = 0;
+				vec3 normal(0, 0, 0);
+				for (int k = 0; k < 3; ++k) {
+					float* vertex = &mesh->vertices[mesh->indices[f * 3 + k] * 8];
+					vec3 p = transformPoint(transforms[m], vertex);
+					sx[k] = (p.dot(right) / radius * 0.5f + 0.5f) * viewSize;
+					sy[k] = (0.5f - p.dot(up) / radius * 0.5f) * viewSize;
+					sz[k] = p.dot(toCamera);
+					u += vertex[3] / 3.0f;
+					v += vertex[4] / 3.0f;
+					normal += transformNormal(transforms[m], &vertex[5]);
+				}
+				float area = edge(sx[0], sy[0], sx[1], sy[1], sx[2], sy[2]);
+				if (area == 0) continue;
+
+				// Flat shaded with the texel at the triangle's center
+				int texel = colors->at(Kore::min(colors->width - 1, Kore::max(0, (int)(u * colors->width))), Kore::min(colors->height - 1, Kore::max(0, (int)((1.0f - v) * colors->height))));
+				float shade = 0.5f + 0.5f * Kore::max(0.0f, normal.normalize().dot(light));
+				int color = packColor((texel & 0xff) / 255.0f * shade, ((texel >> 8) & 0xff) / 255.0f * shade, ((texel >> 16) & 0xff) / 255.0f * shade, 1.0f);
+
+				int xmin = Kore::max(0, (int)Kore::min(sx[0], Kore::min(sx[1], sx[2])));
+				int xmax = Kore::min(viewSize - 1, (int)Kore::max(sx[0], Kore::max(sx[1], sx[2])));
+				int ymin = Kore::max(0, (int)Kore::min(sy[0], Kore::min(sy[1], sy[2])));
+				int ymax = Kore::min(viewSize - 1, (int)Kore::max(sy[0], Kore::max(sy[1], sy[2])));
+				for (int y = ymin; y <= ymax; ++y) {
+					for (int x = xmin; x <= xmax; ++x) {
+						float px = x + 0.5f;
+						float py = y + 0.5f;
+						float w0 = edge(sx[1], sy[1], sx[2], sy[2], px, py) / area;
+						float w1 = edge(sx[2], sy[2], sx[0], sy[0], px, py) / area;
+						float w2 = 1.0f - w0 - w1;
+						if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+						float z = w0 * sz[0] + w1 * sz[1] + w2 * sz[2];
+						if (z <= depth[y * viewSize + x]) continue;
+						depth[y * viewSize + x] = z;
+						pixels[y * atlas->texWidth + view * viewSize + x] = color;
+					}
+				}
+			}
+		}
+	}
+
+	delete[] depth;
+	atlas->unlock();
+
+	quads = new VertexBuffer*[views];
+	for (int view = 0; view < views; ++view) {
+		float u1 = (float)view / views;
+		float u2 = (float)(view + 1) / views;
+		quads[view] = new VertexBuffer(4, *structures[0], 0);
+		float* vertices = quads[view]->lock();
+		setVertex(vertices, 0, -radius, -radius, 0, u1, 1);
+		setVertex(vertices, 1, -radius, radius, 0, u1, 0);
+		setVertex(vertices, 2, radius, radius, 0, u2, 0);
+		setVertex(vertices, 3, radius, -radius, 0, u2, 1);
+		quads[view]->unlock();
+	}
+
+	indexBuffer = new IndexBuffer(6);
+	int* indices = indexBuffer->lock();
+	indices[0] = 0;
+	indices[1] = 1;
+	indices[2] = 2;
+	indices[3] = 0;
+	indices[4] = 2;
+	indices[5] = 3;
+	indexBuffer->unlock();
+}
+
+int Impostor::viewFor(vec3 direction) const {
+	float angle = Kore::atan2(direction.x(), direction.z());
+	int view = (int)Kore::round(angle / (2.0f * pi) * views);
+	return ((view % views) + views) % views;
+}
+
+void Impostor::render(CommandBuffer& commands, TextureUnit tex, int view, VertexBuffer* instances, int count) {
+	VertexBuffer* vertexBuffers[2];
+	vertexBuffers[0] = quads[view];
+	vertexBuffers[1] = instances;
+	commands.setTexture(tex, atlas);
+	commands.setVertexBuffers(vertexBuffers, 2);
+	commands.setIndexBuffer(indexBuffer);
+	commands.drawIndexedVerticesInstanced(count);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Graphics.h"
+
+#include "ObjLoader.h"
+
+class CommandBuffer;
+
+// A few pre-rendered views of a mesh made of several parts, packed side by side
+// into one atlas. Far away objects are drawn as camera facing quads showing the
+// view closest to the direction they are seen from.
+class Impostor {
+public:
+	// transforms place each mesh in the object's frame, colors is sampled with the mesh uvs
+	Impostor(Mesh** meshes, Kore::mat4* transforms, int meshCount, Kore::Image* colors, Kore::VertexStructure** structures, int views = 8, int viewSize = 64, float elevation = 0.5f);
+
+	// direction points from the object to the camera, in the object's frame
+	int viewFor(Kore::vec3 direction) const;
+
+	// Quad of the given view in vertexBuffers[0], vertexBuffers[1] is left to the caller
+	void render(CommandBuffer& commands, Kore::TextureUnit tex, int view, Kore::VertexBuffer* instances, int count);
+
+	float radius;
+	int views;
+	Kore::Texture* atlas;
+
+private:
+	Kore::VertexBuffer** quads;
+	Kore::IndexBuffer* indexBuffer;
+};
@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "InstanceBufferRing.h"
+#include "CommandBuffer.h"
+
+#include <Kore/Log.h>
+
+using namespace Kore;
+
+namespace {
+	int frameCount = 0;
+}
+
+InstanceBufferRing::InstanceBufferRing(const VertexStructure& structure, int maxInstances, int regionsPerFrame, int frames) : maxInstances(maxInstances), regionsPerFrame(regionsPerFrame), frames(frames), frame(-1), region(0), active(nullptr) {
+	regions = new VertexBuffer*[regionsPerFrame * frames];
+	for (int i = 0; i < regionsPerFrame * frames; ++i) {
+		regions[i] = new VertexBuffer(maxInstances, structure, 1);
+	}
+}
+
+void InstanceBufferRing::nextFrame() {
+	++frameCount;
+}
+
+VertexBuffer* InstanceBufferRing::next() {
+	if (frame != frameCount) {
+		frame = frameCount;
+		region = 0;
+	}
+	if (region >= regionsPerFrame) {
+		// More draws than planned for - reusing a region of this frame can stall
+		log(Warning, "Instance buffer ring exhausted (%i regions per frame)", regionsPerFrame);
+		region = 0;
+	}
+	active = regions[(frame % frames) * regionsPerFrame + region];
+	++region;
+	return active;
+}
+
+float* InstanceBufferRing::lock() {
+	VertexBuffer* buffer = next();
+	CommandBuffer::countLock(buffer->count() * buffer->stride());
+	return buffer->lock();
+}
+
+void InstanceBufferRing::unlock() {
+	active->unlock();
+}
+
+VertexBuffer* InstanceBufferRing::current() {
+	return active;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Graphics.h"
+
+// Hands out a fresh instance vertex buffer for every instanced draw of a frame.
+// Kore has no base-instance offsets or fences, so every region is its own small
+// VertexBuffer and a region is only handed out again after `frames` frames have
+// passed - by then the GPU is done reading it and locking it never has to wait.
+class InstanceBufferRing {
+public:
+	InstanceBufferRing(const Kore::VertexStructure& structure, int maxInstances, int regionsPerFrame, int frames = 3);
+
+	// Call once per frame before the first draw
+	static void nextFrame();
+
+	Kore::VertexBuffer* next();
+	float* lock();
+	void unlock();
+	Kore::VertexBuffer* current();
+
+	int maxInstances;
+
+private:
+	Kore::VertexBuffer** regions;
+	int regionsPerFrame;
+	int frames;
+	int frame;
+	int region;
+	Kore::VertexBuffer* active;
+};
@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "InstanceSlots.h"
+#include "CommandBuffer.h"
+
+using namespace Kore;
+
+namespace {
+	// Clean slots between two dirty ones that are still rewritten to save a lock
+	const int maxGap = 4;
+}
+
+InstanceSlots::InstanceSlots(const VertexStructure& structure, int maxInstances, int frames) : uploaded(0), maxInstances(maxInstances), freeCount(0), highWater(0), frames(frames), current(-1) {
+	buffers = new VertexBuffer*[frames];
+	firstDirty = new int[frames];
+	lastDirty = new int[frames];
+	for (int b = 0; b < frames; ++b) {
+		buffers[b] = new VertexBuffer(maxInstances, structure, 1);
+		firstDirty[b] = maxInstances;
+		lastDirty[b] = -1;
+	}
+	vertexBuffer = buffers[0];
+	stride = vertexBuffer->stride() / 4;
+	data = new float[maxInstances * stride];
+	for (int i = 0; i < maxInstances * stride; ++i) data[i] = 0;
+	dirty = new unsigned[maxInstances];
+	used = new bool[maxInstances];
+	for (int i = 0; i < maxInstances; ++i) {
+		dirty[i] = 0;
+		used[i] = false;
+	}
+	freeSlots = new int[maxInstances];
+}
+
+int InstanceSlots::allocate() {
+	int slot;
+	if (freeCount > 0) slot = freeSlots[--freeCount];
+	else if (highWater < maxInstances) slot = highWater++;
+	else return -1;
+	used[slot] = true;
+	return slot;
+}
+
+void InstanceSlots::free(int slot) {
+	if (slot < 0 || !used[slot]) return;
+	used[slot] = false;
+	float* instance = &data[slot * stride];
+	for (int i = 0; i < stride; ++i) instance[i] = 0;
+	markDirty(slot);
+	freeSlots[freeCount++] = slot;
+}
+
+float* InstanceSlots::write(int slot) {
+	markDirty(slot);
+	return &data[slot * stride];
+}
+
+void InstanceSlots::markDirty(int slot) {
+	dirty[slot] = (1u << frames) - 1;
+	for (int b = 0; b < frames; ++b) {
+		firstDirty[b] = Kore::min(firstDirty[b], slot);
+		lastDirty[b] = Kore::max(lastDirty[b], slot);
+	}
+}
+
+void InstanceSlots::upload() {
+	current = (current + 1) % frames;
+	vertexBuffer = buffers[current];
+	unsigned bit = 1u << current;
+	uploaded = 0;
+	int slot = firstDirty[current];
+	while (slot <= lastDirty[current]) {
+		if (!(dirty[slot] & bit)) {
+			++slot;
+			continue;
+		}
+		int start = slot;
+		int end = slot;
+		for (int next = slot + 1; next <= lastDirty[current] && next <= end + maxGap; ++next) {
+			if (dirty[next] & bit) end = next;
+		}
+		CommandBuffer::countLock((end - start + 1) * stride * 4);
+		float* target = vertexBuffer->lock(start, end - start + 1);
+		for (int i = 0; i < (end - start + 1) * stride; ++i) target[i] = data[start * stride + i];
+		vertexBuffer->unlock();
+		for (int i = start; i <= end; ++i) dirty[i] &= ~bit;
+		uploaded += end - start + 1;
+		slot = end + 1;
+	}
+	firstDirty[current] = maxInstances;
+	lastDirty[current] = -1;
+}
+
+int InstanceSlots::count() const {
+	return highWater;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Graphics.h"
+
+// Instance data that rarely changes. Every instance keeps its slot until it is
+// freed, writes go to a copy in memory and mark the slot dirty, and upload()
+// only rewrites the dirty slots, merging neighbouring ones into one lock each.
+// Like InstanceBufferRing there is one buffer per frame in flight, so a lock never
+// touches a buffer the GPU may still read - each buffer catches up on the slots
+// that changed since it was last used.
+class InstanceSlots {
+public:
+	InstanceSlots(const Kore::VertexStructure& structure, int maxInstances, int frames = 3);
+
+	// -1 when all slots are taken
+	int allocate();
+	// Zeroes the slot, which collapses its matrices so nothing is drawn
+	void free(int slot);
+	// Marks the slot dirty, the returned data has to be filled completely
+	float* write(int slot);
+	// Once per frame, switches vertexBuffer to the next buffer and brings it up to date
+	void upload();
+
+	// Draw this many instances, freed slots below it are degenerate
+	int count() const;
+
+	Kore::VertexBuffer* vertexBuffer;
+	// Instances rewritten by the last upload
+	int uploaded;
+
+private:
+	void markDirty(int slot);
+
+	int maxInstances;
+	int stride;
+	float* data;
+	// Bit b for buffers[b]
+	unsigned* dirty;
+	bool* used;
+	int* freeSlots;
+	int freeCount;
+	int highWater;
+	Kore::VertexBuffer** buffers;
+	int frames;
+	int current;
+	int* firstDirty;
+	int* lastDirty;
+};
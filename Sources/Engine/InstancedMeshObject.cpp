@@ -7,36 +7,50 @@
 #include <Kore/Math/Core.h>
 #include <Kore/System.h>
 #include <Kore/Graphics/Image.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 
 #include <cassert>
+#include <string.h>
 
+#include "CommandBuffer.h"
+#include "InstanceBufferRing.h"
 #include "ObjLoader.h"
 #include "PhysicsObject.h"
 #include "Rendering.h"
+#include "TextureLoader.h"
 
 using namespace Kore;
 
-InstancedMeshObject::InstancedMeshObject(const char* meshFile, const char* textureFile, VertexStructure** structures, int maxCount, float scale) {
-	mesh = loadObj(meshFile);
-	image = new Texture(textureFile, true);
-		
+InstancedMeshObject::InstancedMeshObject(const char* meshFile, const char* textureFile, VertexStructure** structures, int maxCount, float scale, const PackedLocations* packed)
+	: InstancedMeshObject(loadObj(meshFile), loadTexture(textureFile, true), structures, maxCount, scale, packed) {
+	strncpy(this->meshFile, meshFile, sizeof(this->meshFile) - 1);
+	this->meshFile[sizeof(this->meshFile) - 1] = 0;
+}
+
+InstancedMeshObject::InstancedMeshObject(Mesh* mesh, Texture* image, VertexStructure** structures, int maxCount, float scale, const PackedLocations* packed)
+	: lods(nullptr), mesh(mesh), image(image), packed(packed), instanceStructure(structures[1]), maxCount(maxCount), instances(nullptr) {
+	meshFile[0] = 0;
 	vertexBuffers = new VertexBuffer*[2];
 	vertexBuffers[0] = new VertexBuffer(mesh->numVertices, *structures[0], 0);
 	float* vertices = vertexBuffers[0]->lock();
-	for (int i = 0; i < mesh->numVertices; ++i) {
-		vertices[i * 8 + 0] = mesh->vertices[i * 8 + 0] * scale;
-		vertices[i * 8 + 1] = mesh->vertices[i * 8 + 1] * scale;
-		vertices[i * 8 + 2] = mesh->vertices[i * 8 + 2] * scale;
-		vertices[i * 8 + 3] = mesh->vertices[i * 8 + 3];
-		vertices[i * 8 + 4] = 1.0f - mesh->vertices[i * 8 + 4];
-		vertices[i * 8 + 5] = mesh->vertices[i * 8 + 5];
-		vertices[i * 8 + 6] = mesh->vertices[i * 8 + 6];
-		vertices[i * 8 + 7] = mesh->vertices[i * 8 + 7];
+	if (packed != nullptr) {
+		range = packVertices(mesh, scale, (short*)vertices);
+	}
+	else {
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			vertices[i * 8 + 0] = mesh->vertices[i * 8 + 0] * scale;
+			vertices[i * 8 + 1] = mesh->vertices[i * 8 + 1] * scale;
+			vertices[i * 8 + 2] = mesh->vertices[i * 8 + 2] * scale;
+			vertices[i * 8 + 3] = mesh->vertices[i * 8 + 3];
+			vertices[i * 8 + 4] = 1.0f - mesh->vertices[i * 8 + 4];
+			vertices[i * 8 + 5] = mesh->vertices[i * 8 + 5];
+			vertices[i * 8 + 6] = mesh->vertices[i * 8 + 6];
+			vertices[i * 8 + 7] = mesh->vertices[i * 8 + 7];
+		}
 	}
 	vertexBuffers[0]->unlock();
-		
-	vertexBuffers[1] = new VertexBuffer(maxCount, *structures[1], 1);
+	// Set by lockInstances(), or by users that write their instances only once
+	vertexBuffers[1] = nullptr;
 
 	indexBuffer = new IndexBuffer(mesh->numFaces * 3);
 	int* indices = indexBuffer->lock();
@@ -46,9 +60,35 @@ InstancedMeshObject::InstancedMeshObject(const char* meshFile, const char* textu
 	indexBuffer->unlock();
 }
 
+void InstancedMeshObject::buildLods() {
+	if (lods == nullptr) lods = loadLods(meshFile, mesh, indexBuffer, MeshLods::firstDistance);
+}
+
 void InstancedMeshObject::render(TextureUnit tex, int instances) {
 	Graphics::setTexture(tex, image);
+	if (packed != nullptr) setPackedRange(*packed, range);
 	Graphics::setVertexBuffers(vertexBuffers, 2);
 	Graphics::setIndexBuffer(*indexBuffer);
 	Graphics::drawIndexedVerticesInstanced(instances);
+}
+
+void InstancedMeshObject::render(CommandBuffer& commands, TextureUnit tex, int instances, float distance) {
+	commands.setTexture(tex, image);
+	if (packed != nullptr) setPackedRange(commands, *packed, range);
+	commands.setVertexBuffers(vertexBuffers, 2);
+	commands.setIndexBuffer(lods != nullptr ? lods->select(distance) : indexBuffer);
+	commands.drawIndexedVerticesInstanced(instances);
+}
+
+float* InstancedMeshObject::lockInstances() {
+	if (instances == nullptr) {
+		instances = new InstanceBufferRing(*instanceStructure, maxCount, 1);
+	}
+	float* data = instances->lock();
+	vertexBuffers[1] = instances->current();
+	return data;
+}
+
+void InstancedMeshObject::unlockInstances() {
+	instances->unlock();
 }
\ No newline at end of file
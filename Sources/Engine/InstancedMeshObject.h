@@ -3,19 +3,50 @@
 #include <Kore/Math/Core.h>
 #include <Kore/System.h>
 #include <Kore/Graphics/Image.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 
+#include "MeshSimplifier.h"
+#include "PackedVertices.h"
 #include "PhysicsObject.h"
 
+class CommandBuffer;
+class InstanceBufferRing;
+
 class InstancedMeshObject {
 public:
-	InstancedMeshObject(const char* meshFile, const char* textureFile, Kore::VertexStructure** structures, int maxCount, float scale = 1.0f);
+	// With packed, structures[0] has to be the packed layout and the program drawing it take the range constants
+	InstancedMeshObject(const char* meshFile, const char* textureFile, Kore::VertexStructure** structures, int maxCount, float scale = 1.0f, const PackedLocations* packed = nullptr);
+	InstancedMeshObject(Mesh* mesh, Kore::Texture* image, Kore::VertexStructure** structures, int maxCount, float scale = 1.0f, const PackedLocations* packed = nullptr);
 	
 	Kore::VertexBuffer** vertexBuffers;
 	void render(Kore::TextureUnit tex, int instances);
+	// distance to the camera picks the level of detail for all instances
+	void render(CommandBuffer& commands, Kore::TextureUnit tex, int instances, float distance = 0);
+
+	// Instance data that changes every frame goes through a buffer ring,
+	// vertexBuffers[1] points to the region that was locked last.
+	// Instance data written only once goes into a buffer of its own put in vertexBuffers[1].
+	float* lockInstances();
+	void unlockInstances();
+
+	// Only for objects drawn with a distance, nothing is simplified before
+	void buildLods();
 
 	Kore::IndexBuffer* indexBuffer;
+	// nullptr until buildLods(), shared with the other objects of the same mesh file
+	const MeshLods* lods;
 
 	Mesh* mesh;
+	// Empty for objects made from a mesh
+	char meshFile[128];
 	Kore::Texture* image;
+
+	// nullptr for the float layout
+	const PackedLocations* packed;
+	PackedRange range;
+
+private:
+	Kore::VertexStructure* instanceStructure;
+	int maxCount;
+	InstanceBufferRing* instances;
 };
@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "JobSystem.h"
+
+JobSystem::JobSystem(int workers) : count(0), generation(0), busy(0), quit(false), next(0), remaining(0) {
+	if (workers <= 0) workers = (int)std::thread::hardware_concurrency() - 1;
+	for (int i = 0; i < workers; ++i) {
+		threads.push_back(std::thread(&JobSystem::work, this));
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (unsigned i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+}
+
+int JobSystem::workers() const {
+	return (int)threads.size();
+}
+
+void JobSystem::parallelFor(int count, std::function<void(int)> job) {
+	if (threads.empty() || count <= 1) {
+		for (int i = 0; i < count; ++i) job(i);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		// Workers that woke up late for the previous loop may still be looking at it
+		done.wait(lock, [this]() { return busy == 0; });
+		this->job = job;
+		this->count = count;
+		next = 0;
+		remaining = count;
+		++generation;
+	}
+	wake.notify_all();
+
+	while (runOne()) {}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return remaining == 0; });
+}
+
+bool JobSystem::runOne() {
+	int index = next++;
+	if (index >= count) return false;
+	job(index);
+	if (--remaining == 0) {
+		std::lock_guard<std::mutex> lock(mutex);
+		done.notify_all();
+	}
+	return true;
+}
+
+void JobSystem::work() {
+	int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen]() { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+			++busy;
+		}
+
+		while (runOne()) {}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0) done.notify_all();
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A few worker threads that split loops with independent iterations between them.
+// The calling thread works on the loop too and parallelFor() only returns once every
+// iteration is done, so jobs can write straight into memory locked by the caller.
+class JobSystem {
+public:
+	// 0 starts one worker per hardware thread besides the calling one
+	JobSystem(int workers = 0);
+	~JobSystem();
+
+	// Calls job(0) to job(count - 1), in any order and on any of the threads
+	void parallelFor(int count, std::function<void(int)> job);
+
+	int workers() const;
+
+private:
+	void work();
+	bool runOne();
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	// Only changed with the mutex held and no worker busy
+	std::function<void(int)> job;
+	int count;
+	int generation;
+	int busy;
+	bool quit;
+	std::atomic<int> next;
+	std::atomic<int> remaining;
+};
@@ -8,27 +8,41 @@
 #include <Kore/Input/Mouse.h>
 #include <Kore/Audio/Mixer.h>
 #include <Kore/Graphics/Image.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 #include <Kore/Log.h>
 
 #include "Collision.h"
+#include "CommandBuffer.h"
+#include "MeshSimplifier.h"
 #include "ObjLoader.h"
+#include "PackedVertices.h"
 #include "Rendering.h"
+#include "TextureLoader.h"
 #include "CollLoader.h"
 #include "assert.h"
 #include "string.h"
 
 class MeshObject {
 public:
-	MeshObject(const char* meshFile, const char* textureFile, Kore::VertexStructure** structures, float scale = 1.0f) {
+	MeshObject(const char* meshFile, const char* textureFile, Kore::VertexStructure** structures, float scale = 1.0f) : lods(nullptr), packed(nullptr) {
 		for (int i = 0; i < colliderCount; ++i) collider[i] = nullptr;
 		mesh = loadObj(meshFile);
-		image = new Kore::Texture(textureFile, true);
+		image = loadTexture(textureFile, true);
+		strncpy(this->textureFile, textureFile, sizeof(this->textureFile) - 1);
+		this->textureFile[sizeof(this->textureFile) - 1] = 0;
+		strncpy(this->meshFile, meshFile, sizeof(this->meshFile) - 1);
+		this->meshFile[sizeof(this->meshFile) - 1] = 0;
 		
 		vertexBuffers = new Kore::VertexBuffer*[2];
 		vertexBuffers[0] = new Kore::VertexBuffer(mesh->numVertices, *structures[0], 0);
 		float* vertices = vertexBuffers[0]->lock();
+		boundsMin = Kore::vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		boundsMax = Kore::vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
 		for (int i = 0; i < mesh->numVertices; ++i) {
+			for (int c = 0; c < 3; ++c) {
+				boundsMin[c] = Kore::min(boundsMin[c], mesh->vertices[i * 8 + c]);
+				boundsMax[c] = Kore::max(boundsMax[c], mesh->vertices[i * 8 + c]);
+			}
 			vertices[i * 8 + 0] = mesh->vertices[i * 8 + 0];
 			vertices[i * 8 + 1] = mesh->vertices[i * 8 + 1];
 			vertices[i * 8 + 2] = mesh->vertices[i * 8 + 2];
@@ -50,15 +64,21 @@ public:
 		indexBuffer->unlock();
 	}
     
-    MeshObject(const char* meshFile, const char* colliderFile, const char* textureFile, const Kore::VertexStructure& structure, float scale) {
+    // With packed, structure has to be the packed layout and the program drawing it take the range constants
+    MeshObject(const char* meshFile, const char* colliderFile, const char* textureFile, const Kore::VertexStructure& structure, float scale, const PackedLocations* packed = nullptr) : lods(nullptr), packed(packed) {
 		for (int i = 0; i < colliderCount; ++i) collider[i] = nullptr;
         mesh = loadObj(meshFile);
-        image = new Kore::Texture(textureFile, true);
+        image = loadTexture(textureFile, true);
+        strncpy(this->textureFile, textureFile, sizeof(this->textureFile) - 1);
+        this->textureFile[sizeof(this->textureFile) - 1] = 0;
+        strncpy(this->meshFile, meshFile, sizeof(this->meshFile) - 1);
+        this->meshFile[sizeof(this->meshFile) - 1] = 0;
 		vertexBuffers = nullptr;
         
         // Mesh Vertex Buffer
         vertexBuffer = new Kore::VertexBuffer(mesh->numVertices, structure, 0);
         float* vertices = vertexBuffer->lock();
+		if (packed != nullptr) range = packVertices(mesh, 1.0f, (short*)vertices);
 
 		Kore::vec4 min1(10000, 100000, 1999909, 1);
 		Kore::vec4 max1(-10000, -100000, -1999909, 1);
@@ -69,6 +89,7 @@ public:
 			max1.y() = Kore::max(max1.y(), mesh->vertices[i * 8 + 1]);
 			min1.z() = Kore::min(min1.z(), mesh->vertices[i * 8 + 2]);
 			max1.z() = Kore::max(max1.z(), mesh->vertices[i * 8 + 2]);
+			if (packed != nullptr) continue;
 
             vertices[i * 8 + 0] = mesh->vertices[i * 8 + 0];
             vertices[i * 8 + 1] = mesh->vertices[i * 8 + 1];
@@ -80,6 +101,8 @@ public:
             vertices[i * 8 + 7] = mesh->vertices[i * 8 + 7];
         }
         vertexBuffer->unlock();
+        boundsMin = Kore::vec3(min1.x(), min1.y(), min1.z());
+        boundsMax = Kore::vec3(max1.x(), max1.y(), max1.z());
         
         indexBuffer = new Kore::IndexBuffer(mesh->numFaces * 3);
         int* indices = indexBuffer->lock();
@@ -131,18 +154,44 @@ public:
     
     void render(Kore::TextureUnit tex, Kore::ConstantLocation mLocation) {
         Kore::Graphics::setTexture(tex, image);
+        if (packed != nullptr) setPackedRange(*packed, range);
         Kore::Graphics::setVertexBuffer(*vertexBuffer);
         Kore::Graphics::setIndexBuffer(*indexBuffer);
         Kore::Graphics::drawIndexedVertices();
     }
 
+	// Only for objects drawn with a distance, static batches use the full mesh
+	void buildLods() {
+		if (lods == nullptr) lods = loadLods(meshFile, mesh, indexBuffer, MeshLods::firstDistance);
+	}
+
+	// distance to the camera picks the level of detail once buildLods() was called
+	void render(CommandBuffer& commands, Kore::TextureUnit tex, float distance = 0) {
+		commands.setTexture(tex, image);
+		if (packed != nullptr) setPackedRange(commands, *packed, range);
+		commands.setVertexBuffer(vertexBuffer);
+		commands.setIndexBuffer(lods != nullptr ? lods->select(distance) : indexBuffer);
+		commands.drawIndexedVertices();
+	}
+
 	Kore::VertexBuffer** vertexBuffers;
     Kore::VertexBuffer* vertexBuffer;
 	Kore::IndexBuffer* indexBuffer;
+	// Simplified from MeshLods::firstDistance on, indexBuffer is the first level.
+	// nullptr until buildLods(), shared with the other objects of the same mesh file.
+	const MeshLods* lods;
     
     static const int colliderCount = 15;
     BoxCollider* collider[colliderCount];
 
 	Mesh* mesh;
 	Kore::Texture* image;
+	char meshFile[128];
+	char textureFile[128];
+	// Of the vertices, in object space
+	Kore::vec3 boundsMin;
+	Kore::vec3 boundsMax;
+	// nullptr for the float layout
+	const PackedLocations* packed;
+	PackedRange range;
 };
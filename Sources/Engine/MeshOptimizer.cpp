@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <string.h>
+#include <vector>
+
+namespace {
+	// Recently used vertices score higher, the three of the last triangle a bit less so
+	// the next one does not reuse all of them. Vertices with few triangles left score
+	// higher too, so that no lone triangles are left behind.
+	float vertexScore(int cachePosition, int remaining) {
+		if (remaining == 0) return -1;
+		float score = 0;
+		if (cachePosition >= 0) {
+			if (cachePosition < 3) score = 0.75f;
+			else score = powf(1.0f - (cachePosition - 3) / (float)(vertexCacheSize - 3), 1.5f);
+		}
+		return score + 2.0f / sqrtf((float)remaining);
+	}
+}
+
+void optimizeVertexCache(int* indices, int faceCount, int vertexCount) {
+	// Triangles of every vertex, the first remaining[v] of them are not drawn yet
+	std::vector<int> remaining(vertexCount, 0);
+	for (int i = 0; i < faceCount * 3; ++i) ++remaining[indices[i]];
+	std::vector<int> offsets(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; ++v) offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<int> triangles(faceCount * 3);
+	std::vector<int> filled(vertexCount, 0);
+	for (int i = 0; i < faceCount * 3; ++i) {
+		int v = indices[i];
+		triangles[offsets[v] + filled[v]++] = i / 3;
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (int v = 0; v < vertexCount; ++v) score[v] = vertexScore(-1, remaining[v]);
+	std::vector<float> triangleScore(faceCount);
+	std::vector<bool> drawn(faceCount, false);
+	for (int t = 0; t < faceCount; ++t) {
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+	}
+
+	std::vector<int> order(faceCount * 3);
+	int cache[vertexCacheSize + 3];
+	int cacheCount = 0;
+	int best = -1;
+	int nextUndrawn = 0;
+	for (int d = 0; d < faceCount; ++d) {
+		if (best < 0) {
+			// Nothing in the cache leads on, start over somewhere else
+			while (drawn[nextUndrawn]) ++nextUndrawn;
+			best = nextUndrawn;
+		}
+		drawn[best] = true;
+		int* corners = &indices[best * 3];
+		memcpy(&order[d * 3], corners, 3 * sizeof(int));
+
+		for (int c = 0; c < 3; ++c) {
+			int v = corners[c];
+			int* list = &triangles[offsets[v]];
+			for (int i = 0; i < remaining[v]; ++i) {
+				if (list[i] == best) {
+					list[i] = list[remaining[v] - 1];
+					list[remaining[v] - 1] = best;
+					--remaining[v];
+					break;
+				}
+			}
+		}
+
+		// The new triangle's vertices move to the front, everything else one back
+		int updated[vertexCacheSize + 3];
+		int count = 0;
+		for (int c = 0; c < 3; ++c) {
+			int v = corners[c];
+			bool twice = false;
+			for (int i = 0; i < count; ++i) twice = twice || updated[i] == v;
+			if (!twice) updated[count++] = v;
+		}
+		for (int i = 0; i < cacheCount; ++i) {
+			int v = cache[i];
+			if (v != corners[0] && v != corners[1] && v != corners[2]) updated[count++] = v;
+		}
+		for (int i = 0; i < count; ++i) {
+			cachePosition[updated[i]] = i < vertexCacheSize ? i : -1;
+		}
+		cacheCount = count < vertexCacheSize ? count : vertexCacheSize;
+		memcpy(cache, updated, cacheCount * sizeof(int));
+
+		// Only vertices that moved changed their score, the best next triangle uses one of them
+		for (int i = 0; i < count; ++i) {
+			int v = updated[i];
+			score[v] = vertexScore(cachePosition[v], remaining[v]);
+		}
+		best = -1;
+		float bestScore = -1;
+		for (int i = 0; i < count; ++i) {
+			int v = updated[i];
+			for (int j = 0; j < remaining[v]; ++j) {
+				int t = triangles[offsets[v] + j];
+				triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+	memcpy(indices, order.data(), faceCount * 3 * sizeof(int));
+}
+
+int optimizeVertexFetch(float* vertices, int stride, int* indices, int faceCount, int vertexCount) {
+	std::vector<int> remap(vertexCount, -1);
+	std::vector<float> reordered;
+	reordered.reserve(vertexCount * stride);
+	int count = 0;
+	for (int i = 0; i < faceCount * 3; ++i) {
+		int v = indices[i];
+		if (remap[v] < 0) {
+			remap[v] = count++;
+			reordered.insert(reordered.end(), &vertices[v * stride], &vertices[(v + 1) * stride]);
+		}
+		indices[i] = remap[v];
+	}
+	memcpy(vertices, reordered.data(), reordered.size() * sizeof(float));
+	return count;
+}
+
+float averageCacheMissRatio(const int* indices, int faceCount) {
+	if (faceCount == 0) return 0;
+	int fifo[vertexCacheSize];
+	int size = 0;
+	int oldest = 0;
+	int misses = 0;
+	for (int i = 0; i < faceCount * 3; ++i) {
+		bool hit = false;
+		for (int c = 0; c < size; ++c) hit = hit || fifo[c] == indices[i];
+		if (hit) continue;
+		++misses;
+		if (size < vertexCacheSize) {
+			fifo[size++] = indices[i];
+		}
+		else {
+			fifo[oldest] = indices[i];
+			oldest = (oldest + 1) % vertexCacheSize;
+		}
+	}
+	return misses / (float)faceCount;
+}
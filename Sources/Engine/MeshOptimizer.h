@@ -0,0 +1,19 @@
+#pragma once
+
+// Reorders triangle lists for the GPU. loadObj runs all of it on every mesh it loads.
+
+// Post-transform cache size the triangle order is optimized for and measured with
+const int vertexCacheSize = 32;
+
+// Reorders the triangles so that consecutive ones share vertices that are still in the
+// post-transform cache, greedily by Tom Forsyth's vertex scores
+void optimizeVertexCache(int* indices, int faceCount, int vertexCount);
+
+// Renumbers the vertices in the order the triangles first use them, for fetch locality.
+// vertices has stride floats per vertex, vertices used by no triangle are dropped.
+// Returns the new vertex count.
+int optimizeVertexFetch(float* vertices, int stride, int* indices, int faceCount, int vertexCount);
+
+// Average cache miss ratio, transformed vertices per triangle with a FIFO cache of
+// vertexCacheSize entries. 3 is the worst, about 0.5 the best a regular grid can do.
+float averageCacheMissRatio(const int* indices, int faceCount);
@@ -0,0 +1,329 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+#include <array>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <string>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshOptimizer.h"
+
+using namespace Kore;
+
+namespace {
+	// Meshes smaller than this are drawn as they are at every distance
+	const int minFaces = 64;
+	// Open borders are held in place by planes through them, weighted this much
+	// more than the surface
+	const double borderWeight = 10.0;
+
+	std::map<std::string, MeshLods*> lodCache;
+
+	// Sum of squared distances to planes, a symmetric 4x4 matrix
+	struct Quadric {
+		double a[10];
+
+		Quadric() {
+			memset(a, 0, sizeof(a));
+		}
+
+		void addPlane(double x, double y, double z, double d, double weight) {
+			a[0] += weight * x * x; a[1] += weight * x * y; a[2] += weight * x * z; a[3] += weight * x * d;
+			a[4] += weight * y * y; a[5] += weight * y * z; a[6] += weight * y * d;
+			a[7] += weight * z * z; a[8] += weight * z * d;
+			a[9] += weight * d * d;
+		}
+
+		void add(const Quadric& other) {
+			for (int i = 0; i < 10; ++i) a[i] += other.a[i];
+		}
+
+		double error(const float* p) const {
+			double x = p[0], y = p[1], z = p[2];
+			return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+				+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+				+ a[7] * z * z + 2 * a[8] * z
+				+ a[9];
+		}
+	};
+
+	struct Collapse {
+		double cost;
+		int from;
+		int to;
+		int fromVersion;
+		int toVersion;
+
+		// Cheapest first in a std::priority_queue
+		bool operator<(const Collapse& other) const {
+			return cost > other.cost;
+		}
+	};
+
+	void cross(const float* a, const float* b, float* result) {
+		result[0] = a[1] * b[2] - a[2] * b[1];
+		result[1] = a[2] * b[0] - a[0] * b[2];
+		result[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	float dot(const float* a, const float* b) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void normalOf(const float* p0, const float* p1, const float* p2, float* normal) {
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		cross(e1, e2, normal);
+	}
+
+	long long edgeKey(int a, int b) {
+		return a < b ? ((long long)a << 32) | b : ((long long)b << 32) | a;
+	}
+
+	// Vertices at the same position are collapsed together as one group, which keeps
+	// uv and normal seams closed. Each vertex of a removed group moves to the vertex of
+	// the remaining group with the most similar uv and normal.
+	class Simplifier {
+	public:
+		Simplifier(const Mesh* mesh) : mesh(mesh), liveFaces(0) {
+			std::map<std::array<float, 3>, int> positions;
+			group.resize(mesh->numVertices);
+			for (int v = 0; v < mesh->numVertices; ++v) {
+				const float* vertex = &mesh->vertices[v * 8];
+				std::array<float, 3> key = {{ vertex[0], vertex[1], vertex[2] }};
+				auto found = positions.find(key);
+				if (found == positions.end()) {
+					found = positions.insert(std::make_pair(key, (int)groupVertices.size())).first;
+					groupVertices.push_back(std::vector<int>());
+				}
+				group[v] = found->second;
+				groupVertices[found->second].push_back(v);
+			}
+			int groups = (int)groupVertices.size();
+			groupTriangles.resize(groups);
+			quadrics.resize(groups);
+			version.resize(groups, 0);
+			removed.resize(groups, false);
+
+			corners.assign(mesh->indices, mesh->indices + mesh->numFaces * 3);
+			alive.resize(mesh->numFaces, true);
+			std::unordered_map<long long, int> edgeUses;
+			for (int t = 0; t < mesh->numFaces; ++t) {
+				int g[3] = { groupOf(t, 0), groupOf(t, 1), groupOf(t, 2) };
+				if (g[0] == g[1] || g[1] == g[2] || g[2] == g[0]) {
+					alive[t] = false;
+					continue;
+				}
+				++liveFaces;
+
+				float normal[3];
+				normalOf(position(g[0]), position(g[1]), position(g[2]), normal);
+				float length = sqrtf(dot(normal, normal));
+				if (length > 0) {
+					// Weighted by the area
+					for (int c = 0; c < 3; ++c) normal[c] /= length;
+					for (int c = 0; c < 3; ++c) quadrics[g[c]].addPlane(normal[0], normal[1], normal[2], -dot(normal, position(g[0])), length / 2);
+				}
+				for (int c = 0; c < 3; ++c) {
+					groupTriangles[g[c]].push_back(t);
+					++edgeUses[edgeKey(g[c], g[(c + 1) % 3])];
+				}
+			}
+
+			for (int t = 0; t < mesh->numFaces; ++t) {
+				if (!alive[t]) continue;
+				for (int c = 0; c < 3; ++c) {
+					int a = groupOf(t, c);
+					int b = groupOf(t, (c + 1) % 3);
+					if (edgeUses[edgeKey(a, b)] == 1) addBorder(t, a, b);
+					if (a < b || edgeUses[edgeKey(a, b)] == 1) push(a, b);
+				}
+			}
+		}
+
+		int run(int targetFaces, int* indices) {
+			while (liveFaces > targetFaces && !collapses.empty()) {
+				Collapse next = collapses.top();
+				collapses.pop();
+				if (removed[next.from] || removed[next.to]) continue;
+				if (version[next.from] != next.fromVersion || version[next.to] != next.toVersion) continue;
+				if (flips(next.from, next.to)) continue;
+				collapse(next.from, next.to);
+			}
+
+			int count = 0;
+			for (int t = 0; t < mesh->numFaces; ++t) {
+				if (!alive[t]) continue;
+				memcpy(&indices[count * 3], &corners[t * 3], 3 * sizeof(int));
+				++count;
+			}
+			return count;
+		}
+
+	private:
+		int groupOf(int triangle, int corner) const {
+			return group[corners[triangle * 3 + corner]];
+		}
+
+		// Of the group, the one of its first vertex
+		const float* position(int g) const {
+			return &mesh->vertices[groupVertices[g][0] * 8];
+		}
+
+		void addBorder(int triangle, int a, int b) {
+			float normal[3];
+			normalOf(position(groupOf(triangle, 0)), position(groupOf(triangle, 1)), position(groupOf(triangle, 2)), normal);
+			const float* pa = position(a);
+			const float* pb = position(b);
+			float edge[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+			float plane[3];
+			cross(edge, normal, plane);
+			float length = sqrtf(dot(plane, plane));
+			if (length == 0) return;
+			for (int c = 0; c < 3; ++c) plane[c] /= length;
+			double weight = borderWeight * dot(edge, edge);
+			quadrics[a].addPlane(plane[0], plane[1], plane[2], -dot(plane, pa), weight);
+			quadrics[b].addPlane(plane[0], plane[1], plane[2], -dot(plane, pa), weight);
+		}
+
+		// Both directions, the cheaper one comes up first
+		void push(int a, int b) {
+			Quadric sum = quadrics[a];
+			sum.add(quadrics[b]);
+			Collapse toB = { sum.error(position(b)), a, b, version[a], version[b] };
+			Collapse toA = { sum.error(position(a)), b, a, version[b], version[a] };
+			collapses.push(toB);
+			collapses.push(toA);
+		}
+
+		// Whether moving from onto to turns any of from's remaining triangles around
+		bool flips(int from, int to) const {
+			for (int t : groupTriangles[from]) {
+				if (!alive[t]) continue;
+				int g[3] = { groupOf(t, 0), groupOf(t, 1), groupOf(t, 2) };
+				if (g[0] == to || g[1] == to || g[2] == to) continue;
+				const float* before[3];
+				const float* after[3];
+				for (int c = 0; c < 3; ++c) {
+					before[c] = position(g[c]);
+					after[c] = g[c] == from ? position(to) : before[c];
+				}
+				float oldNormal[3];
+				float newNormal[3];
+				normalOf(before[0], before[1], before[2], oldNormal);
+				normalOf(after[0], after[1], after[2], newNormal);
+				if (dot(oldNormal, newNormal) <= 0) return true;
+			}
+			return false;
+		}
+
+		int closestVertex(int vertex, int g) const {
+			const float* attributes = &mesh->vertices[vertex * 8 + 3];
+			int best = groupVertices[g][0];
+			float bestDistance = -1;
+			for (int candidate : groupVertices[g]) {
+				const float* other = &mesh->vertices[candidate * 8 + 3];
+				float distance = 0;
+				for (int i = 0; i < 5; ++i) distance += (attributes[i] - other[i]) * (attributes[i] - other[i]);
+				if (bestDistance < 0 || distance < bestDistance) {
+					bestDistance = distance;
+					best = candidate;
+				}
+			}
+			return best;
+		}
+
+		void collapse(int from, int to) {
+			for (int t : groupTriangles[from]) {
+				if (!alive[t]) continue;
+				if (groupOf(t, 0) == to || groupOf(t, 1) == to || groupOf(t, 2) == to) {
+					alive[t] = false;
+					--liveFaces;
+					continue;
+				}
+				for (int c = 0; c < 3; ++c) {
+					if (groupOf(t, c) == from) corners[t * 3 + c] = closestVertex(corners[t * 3 + c], to);
+				}
+				groupTriangles[to].push_back(t);
+			}
+			groupTriangles[from].clear();
+			removed[from] = true;
+			quadrics[to].add(quadrics[from]);
+			++version[to];
+
+			std::vector<int>& triangles = groupTriangles[to];
+			int kept = 0;
+			for (unsigned i = 0; i < triangles.size(); ++i) {
+				if (alive[triangles[i]]) triangles[kept++] = triangles[i];
+			}
+			triangles.resize(kept);
+			for (int t : triangles) {
+				for (int c = 0; c < 3; ++c) {
+					int neighbor = groupOf(t, c);
+					if (neighbor != to) push(to, neighbor);
+				}
+			}
+		}
+
+		const Mesh* mesh;
+		std::vector<int> group;
+		std::vector<std::vector<int>> groupVertices;
+		std::vector<std::vector<int>> groupTriangles;
+		std::vector<Quadric> quadrics;
+		std::vector<int> version;
+		std::vector<bool> removed;
+		std::vector<int> corners;
+		std::vector<bool> alive;
+		int liveFaces;
+		std::priority_queue<Collapse> collapses;
+	};
+}
+
+int simplifyMesh(const Mesh* mesh, int targetFaces, int* indices) {
+	Simplifier simplifier(mesh);
+	return simplifier.run(targetFaces, indices);
+}
+
+void MeshLods::build(Mesh* mesh, IndexBuffer* full, float distance) {
+	indexBuffers[0] = full;
+	distances[0] = 0;
+	int* indices = new int[mesh->numFaces * 3];
+	int faces = mesh->numFaces;
+	for (int l = 1; l < levels; ++l) {
+		distances[l] = distance * l;
+		indexBuffers[l] = indexBuffers[l - 1];
+		if (mesh->numFaces < minFaces) continue;
+
+		int count = simplifyMesh(mesh, mesh->numFaces >> l, indices);
+		// Not worth another buffer
+		if (count > faces * 3 / 4) continue;
+		optimizeVertexCache(indices, count, mesh->numVertices);
+		IndexBuffer* buffer = new IndexBuffer(count * 3);
+		memcpy(buffer->lock(), indices, count * 3 * sizeof(int));
+		buffer->unlock();
+		indexBuffers[l] = buffer;
+		faces = count;
+	}
+	delete[] indices;
+}
+
+IndexBuffer* MeshLods::select(float distance) const {
+	int level = 0;
+	while (level + 1 < levels && distance >= distances[level + 1]) ++level;
+	return indexBuffers[level];
+}
+
+const MeshLods* loadLods(const char* meshFile, Mesh* mesh, IndexBuffer* full, float distance) {
+	if (meshFile[0] != 0) {
+		std::map<std::string, MeshLods*>::iterator found = lodCache.find(meshFile);
+		if (found != lodCache.end()) return found->second;
+	}
+	MeshLods* lods = new MeshLods;
+	lods->build(mesh, full, distance);
+	if (meshFile[0] != 0) lodCache[meshFile] = lods;
+	return lods;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Graphics.h"
+#include "ObjLoader.h"
+
+// Simplifies mesh towards targetFaces triangles with quadric error metrics (Garland and
+// Heckbert). Edges collapse into one of their end points, so the result indexes the
+// vertices of mesh and can share its vertex buffer. Writes at most mesh->numFaces * 3
+// indices and returns the triangle count, which stays above targetFaces when every
+// collapse left would flip a triangle.
+int simplifyMesh(const Mesh* mesh, int targetFaces, int* indices);
+
+// The mesh's own index buffer plus simplified ones over the same vertices,
+// each level with about half the triangles of the one before
+struct MeshLods {
+	static const int levels = 3;
+	// Where level 1 starts for MeshObject and InstancedMeshObject
+	static constexpr float firstDistance = 8.0f;
+
+	// Level l is used from distances[l] on, levels that could not be simplified
+	// further share the buffer of the level before
+	Kore::IndexBuffer* indexBuffers[levels];
+	float distances[levels];
+
+	// Level 1 starts at distance, level 2 at twice that
+	void build(Mesh* mesh, Kore::IndexBuffer* full, float distance);
+	Kore::IndexBuffer* select(float distance) const;
+};
+
+// Levels are shared by mesh file name like textures, asking for the same file again
+// returns the same levels and full is not used then. An empty name builds levels
+// that are not shared. Main thread only.
+const MeshLods* loadLods(const char* meshFile, Mesh* mesh, Kore::IndexBuffer* full, float distance);
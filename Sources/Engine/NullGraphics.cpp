@@ -0,0 +1,274 @@
+#include "pch.h"
+
+#ifdef NULL_GRAPHICS
+
+#include "NullGraphics.h"
+
+#include <string.h>
+
+using namespace Kore;
+
+NullGraphics::Stats NullGraphics::stats;
+
+namespace {
+	IndexBuffer* currentIndexBuffer = nullptr;
+	Program* currentProgram = nullptr;
+	Texture* currentTexture = nullptr;
+
+	int sizeOf(VertexData data) {
+		switch (data) {
+		case Float1VertexData:
+			return 4;
+		case Float2VertexData:
+			return 8;
+		case Float3VertexData:
+			return 12;
+		case Float4VertexData:
+			return 16;
+		case Float4x4VertexData:
+			return 64;
+		case Short2NormVertexData:
+			return 4;
+		case Short4NormVertexData:
+			return 8;
+		case ColorVertexData:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	void draw(int indices, int instances) {
+		++NullGraphics::stats.drawCalls;
+		NullGraphics::stats.instances += instances;
+		NullGraphics::stats.triangles += indices / 3 * instances;
+	}
+}
+
+VertexStructure::VertexStructure() : size(0) {
+
+}
+
+void VertexStructure::add(const char* name, VertexData data) {
+	elements[size++] = data;
+}
+
+VertexBuffer::VertexBuffer(int count, const VertexStructure& structure, int instanceDataStepRate) : instanceDataStepRate(instanceDataStepRate), myCount(count), myStride(0) {
+	for (int i = 0; i < structure.size; ++i) {
+		myStride += sizeOf(structure.elements[i]);
+	}
+	data = new float[myCount * myStride / 4];
+}
+
+VertexBuffer::~VertexBuffer() {
+	delete[] data;
+}
+
+float* VertexBuffer::lock() {
+	return lock(0, myCount);
+}
+
+float* VertexBuffer::lock(int start, int count) {
+	NullGraphics::stats.bytesLocked += count * myStride;
+	return &data[start * myStride / 4];
+}
+
+void VertexBuffer::unlock() {
+
+}
+
+int VertexBuffer::count() {
+	return myCount;
+}
+
+int VertexBuffer::stride() {
+	return myStride;
+}
+
+IndexBuffer::IndexBuffer(int count) : myCount(count) {
+	data = new int[count];
+}
+
+IndexBuffer::~IndexBuffer() {
+	delete[] data;
+}
+
+int* IndexBuffer::lock() {
+	NullGraphics::stats.bytesLocked += myCount * 4;
+	return data;
+}
+
+void IndexBuffer::unlock() {
+
+}
+
+int IndexBuffer::count() {
+	return myCount;
+}
+
+// Images still load, everything that reads pixels on the CPU keeps working
+Texture::Texture(const char* filename, bool readable) : Image(filename, readable), texWidth(width), texHeight(height) {
+	pixels = new unsigned char[texWidth * texHeight * 4];
+}
+
+Texture::Texture(int width, int height, Image::Format format, bool readable) : Image(width, height, format, readable), texWidth(width), texHeight(height) {
+	pixels = new unsigned char[texWidth * texHeight * 4];
+}
+
+Texture::~Texture() {
+	delete[] pixels;
+}
+
+unsigned char* Texture::lock() {
+	return pixels;
+}
+
+void Texture::unlock() {
+
+}
+
+int Texture::stride() {
+	return texWidth * 4;
+}
+
+void Texture::setMipmap(Texture* mipmap, int level) {
+	NullGraphics::stats.bytesLocked += mipmap->texWidth * mipmap->texHeight * 4;
+}
+
+Shader::Shader(void* source, int length, ShaderType type) {
+
+}
+
+Program::Program() {
+
+}
+
+void Program::setVertexShader(Shader* shader) {
+
+}
+
+void Program::setFragmentShader(Shader* shader) {
+
+}
+
+void Program::link(const VertexStructure& structure) {
+
+}
+
+void Program::link(VertexStructure** structures, int count) {
+
+}
+
+ConstantLocation Program::getConstantLocation(const char* name) {
+	return ConstantLocation();
+}
+
+TextureUnit Program::getTextureUnit(const char* name) {
+	return TextureUnit();
+}
+
+void Program::set() {
+	if (currentProgram != this) ++NullGraphics::stats.programSwitches;
+	currentProgram = this;
+}
+
+void Graphics::begin(int windowId) {
+	int frames = NullGraphics::stats.frames;
+	memset(&NullGraphics::stats, 0, sizeof(NullGraphics::stats));
+	NullGraphics::stats.frames = frames + 1;
+}
+
+void Graphics::end(int windowId) {
+
+}
+
+bool Graphics::swapBuffers(int windowId) {
+	return true;
+}
+
+void Graphics::clear(unsigned flags, unsigned color, float depth, int stencil) {
+
+}
+
+void Graphics::setMatrix(ConstantLocation location, const mat4& value) {
+	++NullGraphics::stats.constants;
+}
+
+void Graphics::setFloat(ConstantLocation location, float value) {
+	++NullGraphics::stats.constants;
+}
+
+void Graphics::setFloat3(ConstantLocation location, float value1, float value2, float value3) {
+	++NullGraphics::stats.constants;
+}
+
+void Graphics::setFloat4(ConstantLocation location, float value1, float value2, float value3, float value4) {
+	++NullGraphics::stats.constants;
+}
+
+void Graphics::setBool(ConstantLocation location, bool value) {
+	++NullGraphics::stats.constants;
+}
+
+void Graphics::setVertexBuffer(VertexBuffer& vertexBuffer) {
+
+}
+
+void Graphics::setVertexBuffers(VertexBuffer** vertexBuffers, int count) {
+
+}
+
+void Graphics::setIndexBuffer(IndexBuffer& indexBuffer) {
+	currentIndexBuffer = &indexBuffer;
+}
+
+void Graphics::setTexture(TextureUnit unit, Texture* texture) {
+	if (currentTexture != texture) ++NullGraphics::stats.textureSwitches;
+	currentTexture = texture;
+}
+
+void Graphics::setTextureAddressing(TextureUnit unit, TexDir dir, TextureAddressing addressing) {
+
+}
+
+void Graphics::setTextureMinificationFilter(TextureUnit unit, TextureFilter filter) {
+
+}
+
+void Graphics::setTextureMagnificationFilter(TextureUnit unit, TextureFilter filter) {
+
+}
+
+void Graphics::setTextureMipmapFilter(TextureUnit unit, MipmapFilter filter) {
+
+}
+
+void Graphics::setRenderState(RenderState state, bool on) {
+
+}
+
+void Graphics::setRenderState(RenderState state, int value) {
+
+}
+
+void Graphics::setBlendingMode(BlendingOperation source, BlendingOperation destination) {
+
+}
+
+void Graphics::drawIndexedVertices() {
+	draw(currentIndexBuffer->count(), 1);
+}
+
+void Graphics::drawIndexedVertices(int start, int count) {
+	draw(count, 1);
+}
+
+void Graphics::drawIndexedVerticesInstanced(int instanceCount) {
+	draw(currentIndexBuffer->count(), instanceCount);
+}
+
+void Graphics::drawIndexedVerticesInstanced(int instanceCount, int start, int count) {
+	draw(count, instanceCount);
+}
+
+#endif
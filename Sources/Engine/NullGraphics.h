@@ -0,0 +1,210 @@
+#pragma once
+
+#include <Kore/Graphics/Image.h>
+#include <Kore/Math/Matrix.h>
+
+// Stands in for Kore's graphics with NULL_GRAPHICS defined, so the whole frame runs
+// without a window or GPU. Locks hand out real memory, draws and state changes are
+// only counted. Kore itself has to be built without a graphics backend then.
+namespace Kore {
+	enum VertexData {
+		NoVertexData,
+		Float1VertexData,
+		Float2VertexData,
+		Float3VertexData,
+		Float4VertexData,
+		Float4x4VertexData,
+		Short2NormVertexData,
+		Short4NormVertexData,
+		ColorVertexData
+	};
+
+	class VertexStructure {
+	public:
+		VertexStructure();
+		void add(const char* name, VertexData data);
+
+		static const int maxElementsCount = 16;
+		VertexData elements[maxElementsCount];
+		int size;
+	};
+
+	class VertexBuffer {
+	public:
+		VertexBuffer(int count, const VertexStructure& structure, int instanceDataStepRate = 0);
+		virtual ~VertexBuffer();
+		float* lock();
+		float* lock(int start, int count);
+		void unlock();
+		int count();
+		int stride();
+
+		int instanceDataStepRate;
+
+	private:
+		float* data;
+		int myCount;
+		int myStride;
+	};
+
+	class IndexBuffer {
+	public:
+		IndexBuffer(int count);
+		virtual ~IndexBuffer();
+		int* lock();
+		void unlock();
+		int count();
+
+	private:
+		int* data;
+		int myCount;
+	};
+
+	class Texture : public Image {
+	public:
+		Texture(const char* filename, bool readable = false);
+		Texture(int width, int height, Image::Format format, bool readable);
+		virtual ~Texture();
+		unsigned char* lock();
+		void unlock();
+		int stride();
+		void setMipmap(Texture* mipmap, int level);
+
+		int texWidth;
+		int texHeight;
+
+	private:
+		unsigned char* pixels;
+	};
+
+	enum ShaderType {
+		FragmentShader,
+		VertexShader
+	};
+
+	class Shader {
+	public:
+		Shader(void* source, int length, ShaderType type);
+	};
+
+	// Nothing is uploaded, locations only have to be copyable
+	class ConstantLocation {};
+
+	class TextureUnit {};
+
+	class Program {
+	public:
+		Program();
+		void setVertexShader(Shader* shader);
+		void setFragmentShader(Shader* shader);
+		void link(const VertexStructure& structure);
+		void link(VertexStructure** structures, int count);
+		ConstantLocation getConstantLocation(const char* name);
+		TextureUnit getTextureUnit(const char* name);
+		void set();
+	};
+
+	enum RenderState {
+		BlendingState,
+		DepthTest,
+		DepthTestCompare,
+		DepthWrite,
+		BackfaceCulling
+	};
+
+	enum ZCompareMode {
+		ZCompareAlways,
+		ZCompareNever,
+		ZCompareEqual,
+		ZCompareNotEqual,
+		ZCompareLess,
+		ZCompareLessEqual,
+		ZCompareGreater,
+		ZCompareGreaterEqual
+	};
+
+	enum BlendingOperation {
+		BlendOne,
+		BlendZero,
+		SourceAlpha,
+		DestinationAlpha,
+		InverseSourceAlpha,
+		InverseDestinationAlpha
+	};
+
+	enum TextureAddressing {
+		Repeat,
+		Mirror,
+		Clamp,
+		Border
+	};
+
+	enum TexDir {
+		U,
+		V
+	};
+
+	enum TextureFilter {
+		PointFilter,
+		LinearFilter,
+		AnisotropicFilter
+	};
+
+	enum MipmapFilter {
+		NoMipFilter,
+		PointMipFilter,
+		LinearMipFilter
+	};
+
+	namespace Graphics {
+		const int ClearColorFlag = 1;
+		const int ClearDepthFlag = 2;
+		const int ClearStencilFlag = 4;
+
+		void begin(int windowId = 0);
+		void end(int windowId = 0);
+		bool swapBuffers(int windowId = 0);
+		void clear(unsigned flags, unsigned color = 0, float depth = 1.0f, int stencil = 0);
+
+		void setMatrix(ConstantLocation location, const mat4& value);
+		void setFloat(ConstantLocation location, float value);
+		void setFloat3(ConstantLocation location, float value1, float value2, float value3);
+		void setFloat4(ConstantLocation location, float value1, float value2, float value3, float value4);
+		void setBool(ConstantLocation location, bool value);
+
+		void setVertexBuffer(VertexBuffer& vertexBuffer);
+		void setVertexBuffers(VertexBuffer** vertexBuffers, int count);
+		void setIndexBuffer(IndexBuffer& indexBuffer);
+		void setTexture(TextureUnit unit, Texture* texture);
+		void setTextureAddressing(TextureUnit unit, TexDir dir, TextureAddressing addressing);
+		void setTextureMinificationFilter(TextureUnit unit, TextureFilter filter);
+		void setTextureMagnificationFilter(TextureUnit unit, TextureFilter filter);
+		void setTextureMipmapFilter(TextureUnit unit, MipmapFilter filter);
+
+		void setRenderState(RenderState state, bool on);
+		void setRenderState(RenderState state, int value);
+		void setBlendingMode(BlendingOperation source, BlendingOperation destination);
+
+		void drawIndexedVertices();
+		void drawIndexedVertices(int start, int count);
+		void drawIndexedVerticesInstanced(int instanceCount);
+		void drawIndexedVerticesInstanced(int instanceCount, int start, int count);
+	}
+}
+
+namespace NullGraphics {
+	// Everything but frames is reset by Graphics::begin()
+	struct Stats {
+		int frames;
+		int drawCalls;
+		int instances;
+		int triangles;
+		int textureSwitches;
+		int programSwitches;
+		int constants;
+		// Of vertex and index buffers, textures are locked at load time only
+		int bytesLocked;
+	};
+
+	extern Stats stats;
+}
@@ -1,8 +1,12 @@
 #include "pch.h"
 #include "ObjLoader.h"
+#include "MeshOptimizer.h"
 #include <Kore/IO/FileReader.h>
+#include <Kore/Log.h>
 #include <cstring>
 #include <cstdlib>
+#include <unordered_map>
+#include <vector>
 
 using namespace Kore;
 
@@ -82,89 +86,82 @@ namespace {
 		return countFirstCharLines(source, "vt ");
 	}
 
+	// The position, uv and normal of one triangle corner, -1 where the file has none
+	struct Corner {
+		int position;
+		int uv;
+		int normal;
+	};
+
 	void parseVertex(Mesh* mesh, char* line) {
 		char* token;
 		for (int i = 0; i < 3; i++) {
 			token = strtok(nullptr, " ");
 			mesh->curVertex[i] = (float)strtod(token, nullptr);
 		}
-
 		mesh->curVertex += 3;
-		mesh->curVertex[0] = 0;
-		mesh->curVertex[1] = 0;
-		mesh->curVertex += 5;
-
-		mesh->numVertices++;
-	}
-
-	void setUV(Mesh* mesh, int index, float u, float v) {
-		mesh->vertices[(index * 8) + 3] = u;
-		mesh->vertices[(index * 8) + 4] = v;
 	}
 
-	void setNormal(Mesh* mesh, int index, float x, float y, float z) {
-		mesh->vertices[(index * 8) + 5] = x;
-		mesh->vertices[(index * 8) + 6] = y;
-		mesh->vertices[(index * 8) + 7] = z;
+	// v, v/vt, v//vn or v/vt/vn
+	Corner parseCorner(char* token) {
+		Corner corner;
+		char* end;
+		corner.position = (int)strtol(token, &end, 10) - 1;
+		corner.uv = -1;
+		corner.normal = -1;
+		if (end[0] != '/') return corner;
+		if (end[1] != '/') corner.uv = (int)strtol(end + 1, &end, 10) - 1;
+		else ++end;
+		if (end[0] == '/') corner.normal = (int)strtol(end + 1, nullptr, 10) - 1;
+		return corner;
 	}
 
-	void parseFace(Mesh* mesh, char* line) {
-		char* token;
-		int verts[4];
-		int uvIndex[4];
-		int normalIndex[4];
-		bool hasUV[4];
-		bool hasNormal[4];
-		for (int i = 0; i < 3; i++) {
+	void parseFace(Mesh* mesh, char* line, std::vector<Corner>& corners) {
+		Corner face[4];
+		int count = 0;
+		char* token = strtok(nullptr, " ");
+		while (token != nullptr && count < 4) {
+			face[count++] = parseCorner(token);
 			token = strtok(nullptr, " ");
-			char* endPtr;
-			verts[i] = (int)strtol(token, &endPtr, 0) - 1;
-			if (endPtr[0] == '/') {
-				// Parse the uv
-				hasUV[i] = true;
-				uvIndex[i] = (int)strtol(endPtr + 1, &endPtr, 0) - 1;
-			} else {
-				// There is no uv
-				hasUV[i] = false;
-				hasNormal[i] = false;
-			}
-			if (endPtr[0] == '/') {
-				hasNormal[i] = true;
-				normalIndex[i] = (int)strtol(endPtr + 1, nullptr, 0) - 1;
-			} 
-		}
-		token = strtok(nullptr, " ");
-		//char* result;
-		if (token != nullptr) {
-			verts[3] = (int)strtol(token, nullptr, 0) - 1;
-			// We have a quad
-			mesh->curIndex[0] = verts[0];
-			mesh->curIndex[1] = verts[1];
-			mesh->curIndex[2] = verts[2];
-			mesh->curIndex += 3;
-			mesh->curIndex[0] = verts[2];
-			mesh->curIndex[1] = verts[3];
-			mesh->curIndex[2] = verts[0];
-			mesh->curIndex += 3;
-			mesh->numFaces += 2;
 		}
-		else {
-			// We have a triangle
-			for (int i = 0; i < 3; i++) {
-				mesh->curIndex[i] = verts[i];
-
-				if (!hasUV[i]) continue;
+		if (count < 3) return;
 
-				// Set the UVs
-				setUV(mesh, mesh->curIndex[i], mesh->uvs[uvIndex[i] * 2], mesh->uvs[(uvIndex[i] * 2) + 1]);
+		corners.push_back(face[0]);
+		corners.push_back(face[1]);
+		corners.push_back(face[2]);
+		mesh->numFaces += 1;
+		if (count == 4) {
+			// We have a quad
+			corners.push_back(face[2]);
+			corners.push_back(face[3]);
+			corners.push_back(face[0]);
+			mesh->numFaces += 1;
+		}
+	}
 
-				if (!hasNormal[i]) continue;
+	// Every distinct combination of position, uv and normal becomes one vertex
+	void buildVertices(Mesh* mesh, const float* positions, const std::vector<Corner>& corners) {
+		std::unordered_map<long long, int> vertices;
+		mesh->vertices = new float[corners.size() * 8];
+		mesh->numVertices = 0;
+		for (unsigned i = 0; i < corners.size(); ++i) {
+			const Corner& corner = corners[i];
+			long long key = ((long long)corner.position << 42) | ((long long)(corner.uv + 1) << 21) | (long long)(corner.normal + 1);
+			auto found = vertices.find(key);
+			if (found != vertices.end()) {
+				mesh->indices[i] = found->second;
+				continue;
+			}
 
-				// Set the Normal
-				setNormal(mesh, mesh->curIndex[i], mesh->normals[normalIndex[i] * 3], mesh->normals[normalIndex[i] * 3 + 1], mesh->normals[normalIndex[i] * 3 + 2]);
+			float* vertex = &mesh->vertices[mesh->numVertices * 8];
+			memcpy(vertex, &positions[corner.position * 3], 3 * sizeof(float));
+			vertex[3] = corner.uv >= 0 ? mesh->uvs[corner.uv * 2] : 0;
+			vertex[4] = corner.uv >= 0 ? mesh->uvs[corner.uv * 2 + 1] : 0;
+			for (int c = 0; c < 3; ++c) {
+				vertex[5 + c] = corner.normal >= 0 ? mesh->normals[corner.normal * 3 + c] : 0;
 			}
-			mesh->curIndex += 3;
-			mesh->numFaces += 1;
+			vertices[key] = mesh->numVertices;
+			mesh->indices[i] = mesh->numVertices++;
 		}
 	}
 
@@ -186,7 +183,7 @@ namespace {
 		}
 	}
 
-	void parseLine(Mesh* mesh, char* line) {
+	void parseLine(Mesh* mesh, char* line, std::vector<Corner>& corners) {
 		char* token = strtok(line, " ");
 		if (strcmp(token, "v") == 0) {
 			// Read some vertex data
@@ -194,7 +191,7 @@ namespace {
 		}
 		else if (strcmp(token, "f") == 0) {
 			// Read some face data
-			parseFace(mesh, line);
+			parseFace(mesh, line, corners);
 		}
 		else if (strcmp(token, "vt") == 0) {
 			parseUV(mesh, line);
@@ -217,11 +214,13 @@ Mesh* loadObj(const char* filename) {
 	Mesh* mesh = new Mesh;
 
 	int vertices = countVertices(source);
-	mesh->vertices = new float[vertices * 8];
-	mesh->curVertex = mesh->vertices;
+	float* positions = new float[vertices * 3];
+	mesh->curVertex = positions;
 	int faces = countFaces(source);
 	mesh->indices = new int[faces * 3];
 	mesh->curIndex = mesh->indices;
+	std::vector<Corner> corners;
+	corners.reserve(faces * 3);
 	mesh->numUVs = countUVs(source);
 	mesh->uvs = new float[mesh->numUVs * 2];
 	mesh->curUV = mesh->uvs;
@@ -238,11 +237,70 @@ Mesh* loadObj(const char* filename) {
 	
 	int lineNumber = 0;
 	while (line != nullptr) {
-		parseLine(mesh, line);
+		parseLine(mesh, line, corners);
 		lineNumber++;
 		delete[] line;
 		line = tokenize(source, '\n', index);
 	}
 
+	buildVertices(mesh, positions, corners);
+	delete[] positions;
+
+	float missesBefore = averageCacheMissRatio(mesh->indices, mesh->numFaces);
+	optimizeVertexCache(mesh->indices, mesh->numFaces, mesh->numVertices);
+	mesh->numVertices = optimizeVertexFetch(mesh->vertices, 8, mesh->indices, mesh->numFaces, mesh->numVertices);
+	log(Info, "%s: %i positions, %i vertices, ACMR %.2f before and %.2f after reordering", filename, vertices, mesh->numVertices,
+		missesBefore, averageCacheMissRatio(mesh->indices, mesh->numFaces));
+
 	return mesh;
 }
+
+
+Mesh* createBoundingBoxMesh(Mesh* source) {
+	float min[3] = { source->vertices[0], source->vertices[1], source->vertices[2] };
+	float max[3] = { min[0], min[1], min[2] };
+	for (int i = 1; i < source->numVertices; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			min[c] = Kore::min(min[c], source->vertices[i * 8 + c]);
+			max[c] = Kore::max(max[c], source->vertices[i * 8 + c]);
+		}
+	}
+
+	Mesh* mesh = new Mesh;
+	mesh->numVertices = 24;
+	mesh->numFaces = 12;
+	mesh->numUVs = 0;
+	mesh->numNormals = 0;
+	mesh->vertices = new float[24 * 8];
+	mesh->indices = new int[12 * 3];
+	mesh->uvs = nullptr;
+	mesh->normals = nullptr;
+
+	// Four corners per side so every side gets its own normal
+	int v = 0;
+	int f = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int side = 0; side < 2; ++side) {
+			int u = (axis + 1) % 3;
+			int w = (axis + 2) % 3;
+			for (int corner = 0; corner < 4; ++corner) {
+				float* vertex = &mesh->vertices[(v + corner) * 8];
+				vertex[axis] = side == 0 ? min[axis] : max[axis];
+				vertex[u] = (corner == 1 || corner == 2) ? max[u] : min[u];
+				vertex[w] = (corner >= 2) ? max[w] : min[w];
+				vertex[3] = 0.5f;
+				vertex[4] = 0.5f;
+				vertex[5] = 0;
+				vertex[6] = 0;
+				vertex[7] = 0;
+				vertex[5 + axis] = side == 0 ? -1.0f : 1.0f;
+			}
+			int* index = &mesh->indices[f * 3];
+			index[0] = v; index[1] = v + 1; index[2] = v + 2;
+			index[3] = v; index[4] = v + 2; index[5] = v + 3;
+			v += 4;
+			f += 2;
+		}
+	}
+	return mesh;
+}
\ No newline at end of file
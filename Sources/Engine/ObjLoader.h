@@ -18,4 +18,9 @@ struct Mesh {
 	float* curNormal;
 };
 
+// One vertex of 8 floats (position, uv, normal) per distinct combination the faces use,
+// triangles reordered for the vertex cache and vertices in the order they are drawn
 Mesh* loadObj(const char* filename);
+
+// A 12 triangle box around mesh, stands in for it where it covers only a few pixels
+Mesh* createBoundingBoxMesh(Mesh* mesh);
@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "OcclusionBuffer.h"
+
+#include <Kore/Math/Core.h>
+#include <cmath>
+#include <limits>
+
+using namespace Kore;
+
+namespace {
+	// Smallest w that still counts as in front of the camera
+	const float nearW = 0.001f;
+
+	struct Vertex {
+		float x, y, z;
+	};
+}
+
+OcclusionBuffer::OcclusionBuffer(int width, int height) : width(width), height(height), occluderTriangles(0) {
+	depth = new float[width * height];
+	begin(mat4::Identity());
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+	delete[] depth;
+}
+
+void OcclusionBuffer::begin(mat4 PV) {
+	this->PV = PV;
+	occluderTriangles = 0;
+	for (int i = 0; i < width * height; ++i) {
+		depth[i] = std::numeric_limits<float>::max();
+	}
+}
+
+void OcclusionBuffer::addOccluder(const float* vertices, int stride, const int* indices, int faceCount, mat4 M) {
+	mat4 transform = PV * M;
+	for (int t = 0; t < faceCount; ++t) {
+		Vertex corners[3];
+		bool behind = false;
+		for (int c = 0; c < 3 && !behind; ++c) {
+			const float* position = &vertices[indices[t * 3 + c] * stride];
+			vec4 clip = transform * vec4(position[0], position[1], position[2], 1);
+			behind = clip.w() < nearW;
+			corners[c].x = (clip.x() / clip.w() * 0.5f + 0.5f) * width;
+			corners[c].y = (0.5f - clip.y() / clip.w() * 0.5f) * height;
+			corners[c].z = clip.z() / clip.w();
+		}
+		if (behind) continue;
+
+		// Edge functions, positive inside whichever way the triangle winds
+		float area = (corners[1].x - corners[0].x) * (corners[2].y - corners[0].y) - (corners[2].x - corners[0].x) * (corners[1].y - corners[0].y);
+		if (area == 0) continue;
+		float sign = area > 0 ? 1.0f : -1.0f;
+		float a[3], b[3], c[3];
+		for (int k = 0; k < 3; ++k) {
+			const Vertex& from = corners[(k + 1) % 3];
+			const Vertex& to = corners[(k + 2) % 3];
+			a[k] = sign * (from.y - to.y);
+			b[k] = sign * (to.x - from.x);
+			// Moved inwards by half a pixel, a pixel center passing all three has the whole pixel inside
+			c[k] = -(a[k] * from.x + b[k] * from.y) - 0.5f * (Kore::abs(a[k]) + Kore::abs(b[k]));
+		}
+
+		// Depth is linear in screen space, the farthest of a pixel is at one of its corners
+		const Vertex& origin = corners[0];
+		float dzdx = ((corners[1].z - origin.z) * (corners[2].y - origin.y) - (corners[2].z - origin.z) * (corners[1].y - origin.y)) / area;
+		float dzdy = ((corners[2].z - origin.z) * (corners[1].x - origin.x) - (corners[1].z - origin.z) * (corners[2].x - origin.x)) / area;
+		float farthest = 0.5f * (Kore::abs(dzdx) + Kore::abs(dzdy));
+
+		int xMin = Kore::max(0, (int)floorf(Kore::min(corners[0].x, Kore::min(corners[1].x, corners[2].x))));
+		int xMax = Kore::min(width, (int)ceilf(Kore::max(corners[0].x, Kore::max(corners[1].x, corners[2].x))));
+		int yMin = Kore::max(0, (int)floorf(Kore::min(corners[0].y, Kore::min(corners[1].y, corners[2].y))));
+		int yMax = Kore::min(height, (int)ceilf(Kore::max(corners[0].y, Kore::max(corners[1].y, corners[2].y))));
+		for (int y = yMin; y < yMax; ++y) {
+			float py = y + 0.5f;
+			float* row = &depth[y * width];
+			for (int x = xMin; x < xMax; ++x) {
+				float px = x + 0.5f;
+				if (a[0] * px + b[0] * py + c[0] < 0 || a[1] * px + b[1] * py + c[1] < 0 || a[2] * px + b[2] * py + c[2] < 0) continue;
+				float z = origin.z + dzdx * (px - origin.x) + dzdy * (py - origin.y) + farthest;
+				if (z < row[x]) row[x] = z;
+			}
+		}
+		++occluderTriangles;
+	}
+}
+
+bool OcclusionBuffer::isVisible(vec3 min, vec3 max) const {
+	// The screen rectangle around the box and its nearest depth
+	float left = std::numeric_limits<float>::max();
+	float top = std::numeric_limits<float>::max();
+	float right = -std::numeric_limits<float>::max();
+	float bottom = -std::numeric_limits<float>::max();
+	float nearest = std::numeric_limits<float>::max();
+	for (int i = 0; i < 8; ++i) {
+		vec4 clip = PV * vec4((i & 1) ? max.x() : min.x(), (i & 2) ? max.y() : min.y(), (i & 4) ? max.z() : min.z(), 1);
+		// Reaches around the camera
+		if (clip.w() < nearW) return true;
+		float x = (clip.x() / clip.w() * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip.y() / clip.w() * 0.5f) * height;
+		left = Kore::min(left, x);
+		right = Kore::max(right, x);
+		top = Kore::min(top, y);
+		bottom = Kore::max(bottom, y);
+		nearest = Kore::min(nearest, clip.z() / clip.w());
+	}
+
+	// Every pixel the rectangle touches, the frustum decides about boxes off screen
+	int xMin = Kore::max(0, (int)floorf(left));
+	int xMax = Kore::min(width - 1, (int)floorf(right));
+	int yMin = Kore::max(0, (int)floorf(top));
+	int yMax = Kore::min(height - 1, (int)floorf(bottom));
+	if (xMin > xMax || yMin > yMax) return true;
+	for (int y = yMin; y <= yMax; ++y) {
+		const float* row = &depth[y * width];
+		for (int x = xMin; x <= xMax; ++x) {
+			if (row[x] >= nearest) return true;
+		}
+	}
+	return false;
+}
+
+bool OcclusionBuffer::isVisible(vec3 center, float radius) const {
+	return isVisible(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius));
+}
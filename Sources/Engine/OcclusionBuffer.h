@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Kore/Math/Matrix.h>
+
+// A small depth buffer of the big furniture, rasterized on the CPU every frame so that
+// whatever is completely behind it can be skipped before it is submitted. Depth is the
+// normalized device z of the frame's projection, smaller is nearer. Occluders only mark
+// pixels they cover completely, with the farthest depth they have there, so the buffer
+// never hides anything that shows next to them.
+class OcclusionBuffer {
+public:
+	OcclusionBuffer(int width, int height);
+	~OcclusionBuffer();
+
+	// Clears the depth, PV is projection * view of the frame
+	void begin(Kore::mat4 PV);
+
+	// faceCount triangles of vertices with stride floats each, the position first, placed by M.
+	// Triangles reaching in front of the near plane are left out.
+	void addOccluder(const float* vertices, int stride, const int* indices, int faceCount, Kore::mat4 M);
+
+	// Whether anything of the axis aligned box may be in front of the occluders
+	bool isVisible(Kore::vec3 min, Kore::vec3 max) const;
+	bool isVisible(Kore::vec3 center, float radius) const;
+
+	int width;
+	int height;
+	// Rasterized since begin()
+	int occluderTriangles;
+
+private:
+	Kore::mat4 PV;
+	float* depth;
+};
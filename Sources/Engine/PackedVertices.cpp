@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "PackedVertices.h"
+
+#include <Kore/Math/Core.h>
+#include <limits>
+
+#include "CommandBuffer.h"
+
+using namespace Kore;
+
+namespace {
+	// To a signed normalized short, t in -1..1
+	short quantize(float t) {
+		t = Kore::max(-1.0f, Kore::min(1.0f, t));
+		return (short)(t * 32767.0f + (t < 0 ? -0.5f : 0.5f));
+	}
+
+	float signOf(float value) {
+		return value < 0 ? -1.0f : 1.0f;
+	}
+
+	// Projects the normal onto the octahedron |x| + |y| + |z| = 1 and folds the
+	// lower half over the diagonals, which leaves a point in the -1..1 square
+	void octahedral(float x, float y, float z, short* target) {
+		float sum = Kore::abs(x) + Kore::abs(y) + Kore::abs(z);
+		if (sum == 0) {
+			target[0] = target[1] = 0;
+			return;
+		}
+		x /= sum;
+		y /= sum;
+		if (z < 0) {
+			float folded = (1 - Kore::abs(y)) * signOf(x);
+			y = (1 - Kore::abs(x)) * signOf(y);
+			x = folded;
+		}
+		target[0] = quantize(x);
+		target[1] = quantize(y);
+	}
+
+	// Center and half size of count values, never a zero size
+	void range(float* values, int count, int stride, float& center, float& half) {
+		float low = std::numeric_limits<float>::max();
+		float high = -std::numeric_limits<float>::max();
+		for (int i = 0; i < count; ++i) {
+			low = Kore::min(low, values[i * stride]);
+			high = Kore::max(high, values[i * stride]);
+		}
+		if (count == 0) low = high = 0;
+		center = (low + high) / 2;
+		half = Kore::max((high - low) / 2, 0.0001f);
+	}
+}
+
+void addPackedElements(VertexStructure& structure) {
+	structure.add("pos", Short4NormVertexData);
+	structure.add("texnor", Short4NormVertexData);
+}
+
+PackedLocations getPackedLocations(Program* program) {
+	PackedLocations locations;
+	locations.posOffset = program->getConstantLocation("posOffset");
+	locations.posScale = program->getConstantLocation("posScale");
+	locations.uvTransform = program->getConstantLocation("uvTransform");
+	return locations;
+}
+
+PackedRange packVertices(Mesh* mesh, float scale, short* target) {
+	PackedRange packed;
+	float center[5];
+	float half[5];
+	for (int c = 0; c < 5; ++c) {
+		range(&mesh->vertices[c], mesh->numVertices, 8, center[c], half[c]);
+	}
+	for (int c = 0; c < 3; ++c) {
+		packed.posOffset[c] = center[c] * scale;
+		packed.posScale[c] = half[c] * scale;
+	}
+	// v is flipped like in the float buffers, which mirrors its center
+	packed.uvTransform = vec4(center[3], 1.0f - center[4], half[3], half[4]);
+
+	for (int i = 0; i < mesh->numVertices; ++i) {
+		float* vertex = &mesh->vertices[i * 8];
+		short* out = &target[i * 8];
+		for (int c = 0; c < 3; ++c) {
+			out[c] = quantize((vertex[c] - center[c]) / half[c]);
+		}
+		out[3] = 0;
+		out[4] = quantize((vertex[3] - center[3]) / half[3]);
+		out[5] = quantize((center[4] - vertex[4]) / half[4]);
+		octahedral(vertex[5], vertex[6], vertex[7], &out[6]);
+	}
+	return packed;
+}
+
+void setPackedRange(const PackedLocations& locations, const PackedRange& range) {
+	Graphics::setFloat3(locations.posOffset, range.posOffset.x(), range.posOffset.y(), range.posOffset.z());
+	Graphics::setFloat3(locations.posScale, range.posScale.x(), range.posScale.y(), range.posScale.z());
+	Graphics::setFloat4(locations.uvTransform, range.uvTransform.x(), range.uvTransform.y(), range.uvTransform.z(), range.uvTransform.w());
+}
+
+void setPackedRange(CommandBuffer& commands, const PackedLocations& locations, const PackedRange& range) {
+	commands.setFloat3(locations.posOffset, range.posOffset.x(), range.posOffset.y(), range.posOffset.z());
+	commands.setFloat3(locations.posScale, range.posScale.x(), range.posScale.y(), range.posScale.z());
+	commands.setFloat4(locations.uvTransform, range.uvTransform.x(), range.uvTransform.y(), range.uvTransform.z(), range.uvTransform.w());
+}
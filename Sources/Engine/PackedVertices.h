@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Graphics.h"
+#include "ObjLoader.h"
+
+class CommandBuffer;
+
+// Optional compact vertex layout for static meshes, 16 instead of 32 bytes per vertex:
+//   pos     Short4Norm  position relative to the bounds of the mesh, w unused
+//   texnor  Short4Norm  uv relative to the uv bounds in xy, octahedral normal in zw
+// The *_packed vertex shaders map them back with the range of the mesh.
+
+// Maps the normalized values back, value = offset + packed * scale
+struct PackedRange {
+	Kore::vec3 posOffset;
+	Kore::vec3 posScale;
+	// offset in xy, scale in zw
+	Kore::vec4 uvTransform;
+};
+
+// Of the range constants in a program using the packed layout
+struct PackedLocations {
+	Kore::ConstantLocation posOffset;
+	Kore::ConstantLocation posScale;
+	Kore::ConstantLocation uvTransform;
+};
+
+void addPackedElements(Kore::VertexStructure& structure);
+PackedLocations getPackedLocations(Kore::Program* program);
+
+// Writes 8 shorts per vertex of mesh into target, positions scaled and v flipped
+// the same way the float vertex buffers do it
+PackedRange packVertices(Mesh* mesh, float scale, short* target);
+
+void setPackedRange(const PackedLocations& locations, const PackedRange& range);
+void setPackedRange(CommandBuffer& commands, const PackedLocations& locations, const PackedRange& range);
@@ -2,9 +2,10 @@
 
 #include "Particles.h"
 
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 #include <Kore/Math/Random.h>
 
+#include "InstanceBufferRing.h"
 #include "Rendering.h"
 
 using namespace Kore;
@@ -20,6 +21,7 @@ ParticleSystem::ParticleSystem(vec3 pos, vec3 dir, float size, float timeToLive,
 	particlePos = new vec3[maxParticles];
 	particleVel = new vec3[maxParticles];
 	particleTTL = new float[maxParticles];
+	aliveIndices = new int[maxParticles];
 	
 	spawnRate = 0.05f;
 	nextSpawn = spawnRate;
@@ -40,7 +42,10 @@ void ParticleSystem::init(float halfSize, int maxParticles, VertexStructure** st
 	setVertex(vertices, 3, 1 * halfSize, -1 * halfSize, 0, 1, 0);
 	vbs[0]->unlock();
 	
-	vbs[1] = new VertexBuffer(maxParticles, *structures[1], 1);
+	// Created on first render, most systems of a pool are never drawn
+	vbs[1] = nullptr;
+	instances = nullptr;
+	instanceStructure = structures[1];
 
 	// Set index buffer
 	ib = new IndexBuffer(6);
@@ -61,6 +66,7 @@ ParticleSystem::~ParticleSystem()
     delete particlePos;
     delete particleVel;
     delete particleTTL;
+    delete[] aliveIndices;
 }
 
 void ParticleSystem::setPosition(vec3 position) {
@@ -106,24 +112,25 @@ void ParticleSystem::render(TextureUnit tex, ConstantLocation vLocation, mat4 V)
 	view.Set(2, 3, 0.0f);
 
 	int alive = 0;
-	float* data = vbs[1]->lock();
+	if (instances == nullptr) {
+		instances = new InstanceBufferRing(*instanceStructure, numParticles, 1);
+	}
 	for (int i = 0; i < numParticles; i++) {
 		// Skip dead particles
 		if (particleTTL[i] <= 0.0f) continue;
-			
-		mat4 M = mat4::Translation(particlePos[i].x(), particlePos[i].y(), particlePos[i].z()) * mat4::Scale(0.2f, 0.2f, 0.2f);
-		
-		setMatrix(data, alive, 0, 36, M * view);
-		setMatrix(data, alive, 16, 36, calculateN(M * view));
-		
+		aliveIndices[alive++] = i;
+	}
+
+	float* data = instances->lock();
+	vbs[1] = instances->current();
+	setTransforms(data, 0, 36, particlePos, nullptr, nullptr, aliveIndices, alive, mat4::Scale(0.2f, 0.2f, 0.2f) * view);
+	for (int a = 0; a < alive; ++a) {
 		// Interpolate linearly between the two colors
-		float interpolation = particleTTL[i] / totalTimeToLive;
+		float interpolation = particleTTL[aliveIndices[a]] / totalTimeToLive;
 		vec4 col = colorStart * interpolation + colorEnd * (1.0f - interpolation);
-		setVec4(data, alive, 32, 36, col);
-
-		++alive;
+		setVec4(data, a, 32, 36, col);
 	}
-	vbs[1]->unlock();
+	instances->unlock();
 	
 	Graphics::setTexture(tex, texture);
 	Graphics::setVertexBuffers(vbs, 2);
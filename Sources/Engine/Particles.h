@@ -1,8 +1,9 @@
 #pragma once
 
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 
 class Particle;
+class InstanceBufferRing;
 
 class ParticleSystem {
 public:
@@ -16,6 +17,8 @@ public:
 
 //private:
 	Kore::VertexBuffer** vbs;
+	InstanceBufferRing* instances;
+	Kore::VertexStructure* instanceStructure;
 	Kore::IndexBuffer* ib;
 	Kore::Texture* texture;
 
@@ -30,6 +33,7 @@ public:
 	Kore::vec3* particlePos; // The current position
 	Kore::vec3* particleVel; // The current velocity
 	float* particleTTL; // The remaining time to live
+	int* aliveIndices; // Filled while rendering
 
 	// The number of particles
 	int numParticles;
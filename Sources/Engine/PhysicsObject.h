@@ -10,7 +10,7 @@
 #include <Kore/Input/Mouse.h>
 #include <Kore/Audio/Mixer.h>
 #include <Kore/Graphics/Image.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 #include <Kore/Log.h>
 #include "ObjLoader.h"
 
@@ -0,0 +1,96 @@
+#include "pch.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	const int programBits = 7;
+	const int textureBits = 12;
+	const int meshBits = 12;
+
+	// Positive floats sort like their bit patterns
+	unsigned depthBits(float depth) {
+		unsigned bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		return bits;
+	}
+}
+
+void RenderQueue::addProgram(Program* program, std::function<void(CommandBuffer&)> setup) {
+	ProgramSetup entry;
+	entry.program = program;
+	entry.setup = setup;
+	programs.push_back(entry);
+}
+
+void RenderQueue::begin(vec3 cameraPosition) {
+	this->cameraPosition = cameraPosition;
+	queue.clear();
+}
+
+int RenderQueue::idOf(std::vector<const void*>& ids, const void* pointer, int bits) {
+	// Past the limit ids are shared, which only costs some grouping
+	for (unsigned i = 0; i < ids.size(); ++i) {
+		if (ids[i] == pointer) return i & ((1 << bits) - 1);
+	}
+	ids.push_back(pointer);
+	return ((int)ids.size() - 1) & ((1 << bits) - 1);
+}
+
+void RenderQueue::add(Pass pass, Program* program, const void* texture, const void* mesh, vec3 center, std::function<void(CommandBuffer&)> draw) {
+	// Own-state draws sort after everything else of their pass
+	unsigned long long programId = (1 << programBits) - 1;
+	for (unsigned i = 0; i < programs.size(); ++i) {
+		if (programs[i].program == program) programId = i;
+	}
+	unsigned long long textureId = idOf(textureIds, texture, textureBits);
+	unsigned long long meshId = idOf(meshIds, mesh, meshBits);
+	unsigned long long depth = depthBits((center - cameraPosition).getLength());
+
+	Item item;
+	if (pass == Opaque) {
+		item.key = programId << (textureBits + meshBits + 32) | textureId << (meshBits + 32) | meshId << 32 | depth;
+	}
+	else {
+		// Farthest first, the depth leads and loses its lowest bit to the pass bit
+		unsigned long long inverse = ~depth & 0xffffffffull;
+		item.key = 1ull << 63 | (inverse >> 1) << 31 | programId << (textureBits + meshBits) | textureId << meshBits | meshId;
+	}
+	item.program = program;
+	item.draw = draw;
+	queue.push_back(item);
+}
+
+void RenderQueue::submit() {
+	std::stable_sort(queue.begin(), queue.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+
+	items = (int)queue.size();
+	programSwitches = 0;
+	Program* current = nullptr;
+	bool blending = false;
+	commands.setRenderState(BlendingState, false);
+	for (unsigned i = 0; i < queue.size(); ++i) {
+		Item& item = queue[i];
+		bool transparent = (item.key >> 63) != 0;
+		if (transparent != blending) {
+			blending = transparent;
+			commands.setRenderState(BlendingState, blending);
+		}
+		if (item.program != nullptr && item.program != current) {
+			commands.setProgram(item.program);
+			for (unsigned p = 0; p < programs.size(); ++p) {
+				if (programs[p].program == item.program) programs[p].setup(commands);
+			}
+			++programSwitches;
+		}
+		current = item.program;
+		item.draw(commands);
+	}
+	// 2D overlays draw after the queue and expect blending
+	commands.setRenderState(BlendingState, true);
+	commands.execute();
+	queue.clear();
+}
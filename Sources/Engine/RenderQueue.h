@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "CommandBuffer.h"
+#include "Graphics.h"
+
+// Draws collected over a frame and submitted sorted by a key. Opaque draws go
+// first with blending off, grouped by program, texture and mesh and front to back
+// inside a group. Transparent draws follow back to front with blending on.
+// Draws record into the queue's command buffer, which submit() executes at the end.
+class RenderQueue {
+public:
+	enum Pass { Opaque, Transparent };
+
+	// setup runs whenever the queue switches to the program, for uniforms and texture states
+	void addProgram(Kore::Program* program, std::function<void(CommandBuffer&)> setup);
+
+	void begin(Kore::vec3 cameraPosition);
+	// program nullptr for draws that set their own programs, texture and mesh only sort
+	void add(Pass pass, Kore::Program* program, const void* texture, const void* mesh, Kore::vec3 center, std::function<void(CommandBuffer&)> draw);
+	void submit();
+
+	// Statistics of the last submit
+	int items;
+	int programSwitches;
+
+	CommandBuffer commands;
+	// Of the frame since begin()
+	Kore::vec3 cameraPosition;
+
+private:
+	struct Item {
+		unsigned long long key;
+		Kore::Program* program;
+		std::function<void(CommandBuffer&)> draw;
+	};
+
+	struct ProgramSetup {
+		Kore::Program* program;
+		std::function<void(CommandBuffer&)> setup;
+	};
+
+	int idOf(std::vector<const void*>& ids, const void* pointer, int bits);
+
+	std::vector<Item> queue;
+	std::vector<ProgramSetup> programs;
+	std::vector<const void*> textureIds;
+	std::vector<const void*> meshIds;
+};
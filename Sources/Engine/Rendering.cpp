@@ -1,11 +1,66 @@
 #include "pch.h"
 #include "Rendering.h"
 
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define RENDERING_SSE
+#endif
 
 using namespace Kore;
 
+namespace {
+	const float orthogonalEpsilon = 1e-4f;
+
+	// Bigger batches bypass the cache, nothing reads the instance data back
+	const int streamThreshold = 256;
+
+#ifdef RENDERING_SSE
+	// a * b for the columns of a and a column b
+	inline __m128 transformColumn(const __m128* a, __m128 b) {
+		__m128 r = _mm_mul_ps(a[0], _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(a[1], _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(a[2], _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2))));
+		return _mm_add_ps(r, _mm_mul_ps(a[3], _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+#endif
+}
+
 mat4 calculateN(mat4 MV) {
+	// Rotation times scale times translation: the columns of the upper 3x3 are
+	// orthogonal, its inverse transpose is the same columns divided by their squared lengths
+	if (MV.get(3, 0) == 0 && MV.get(3, 1) == 0 && MV.get(3, 2) == 0 && MV.get(3, 3) == 1) {
+		vec3 c0(MV.get(0, 0), MV.get(1, 0), MV.get(2, 0));
+		vec3 c1(MV.get(0, 1), MV.get(1, 1), MV.get(2, 1));
+		vec3 c2(MV.get(0, 2), MV.get(1, 2), MV.get(2, 2));
+		float l0 = c0.squareLength();
+		float l1 = c1.squareLength();
+		float l2 = c2.squareLength();
+		float d01 = c0.dot(c1);
+		float d02 = c0.dot(c2);
+		float d12 = c1.dot(c2);
+		if (l0 > 0 && l1 > 0 && l2 > 0
+			&& d01 * d01 <= orthogonalEpsilon * l0 * l1
+			&& d02 * d02 <= orthogonalEpsilon * l0 * l2
+			&& d12 * d12 <= orthogonalEpsilon * l1 * l2) {
+			c0 *= 1.0f / l0;
+			c1 *= 1.0f / l1;
+			c2 *= 1.0f / l2;
+			vec3 t(MV.get(0, 3), MV.get(1, 3), MV.get(2, 3));
+			mat4 N = mat4::Identity();
+			for (int row = 0; row < 3; ++row) {
+				N.Set(row, 0, c0[row]);
+				N.Set(row, 1, c1[row]);
+				N.Set(row, 2, c2[row]);
+			}
+			// The transposed translation of the inverse
+			N.Set(3, 0, -c0.dot(t));
+			N.Set(3, 1, -c1.dot(t));
+			N.Set(3, 2, -c2.dot(t));
+			return N;
+		}
+	}
 	return MV.Invert().Transpose();
 }
 
@@ -40,21 +95,95 @@ void setVec4(float* data, int instanceIndex, int off, int size, vec4 v) {
 }
 
 void setMatrix(float* data, int instanceIndex, int off, int size, mat4 m) {
-	int offset = off + instanceIndex * size;
-	data[offset +  0] = m[0][0];
-	data[offset +  1] = m[1][0];
-	data[offset +  2] = m[2][0];
-	data[offset +  3] = m[3][0];
-	data[offset +  4] = m[0][1];
-	data[offset +  5] = m[1][1];
-	data[offset +  6] = m[2][1];
-	data[offset +  7] = m[3][1];
-	data[offset +  8] = m[0][2];
-	data[offset +  9] = m[1][2];
-	data[offset + 10] = m[2][2];
-	data[offset + 11] = m[3][2];
-	data[offset + 12] = m[0][3];
-	data[offset + 13] = m[1][3];
-	data[offset + 14] = m[2][3];
-	data[offset + 15] = m[3][3];
+	// mat4 is stored column by column, just like the instance data
+	float* target = &data[off + instanceIndex * size];
+	for (int i = 0; i < 16; ++i) {
+		target[i] = m.data[i];
+	}
+}
+
+void setTransforms(float* data, int off, int size, const vec3* translations, const mat4* rotations, const float* scales, const int* indices, int count, mat4 local) {
+	// (T * R * S * L)^-T = T^-T * R * S^-1 * L^-T, T^-T only changes the bottom row
+	mat4 localN = calculateN(local);
+#ifdef RENDERING_SSE
+	bool stream = count >= streamThreshold && size % 4 == 0 && ((size_t)&data[off] & 15) == 0;
+	__m128 l[4];
+	__m128 ln[4];
+	for (int j = 0; j < 4; ++j) {
+		l[j] = _mm_loadu_ps(&local.data[j * 4]);
+		ln[j] = _mm_loadu_ps(&localN.data[j * 4]);
+	}
+	for (int c = 0; c < count; ++c) {
+		int i = indices == nullptr ? c : indices[c];
+		float s = scales == nullptr ? 1.0f : scales[i];
+		__m128 scale = _mm_set_ps(1.0f, s, s, s);
+		__m128 inverseScale = _mm_set_ps(1.0f, 1.0f / s, 1.0f / s, 1.0f / s);
+		__m128 m[4];
+		__m128 n[4];
+		for (int j = 0; j < 4; ++j) {
+			m[j] = _mm_mul_ps(l[j], scale);
+			n[j] = _mm_mul_ps(ln[j], inverseScale);
+		}
+		if (rotations != nullptr) {
+			__m128 r[4];
+			for (int j = 0; j < 4; ++j) r[j] = _mm_loadu_ps(&rotations[i].data[j * 4]);
+			for (int j = 0; j < 4; ++j) {
+				m[j] = transformColumn(r, m[j]);
+				n[j] = transformColumn(r, n[j]);
+			}
+		}
+		const vec3& t = translations[i];
+		__m128 translation = _mm_set_ps(0.0f, t.z(), t.y(), t.x());
+		for (int j = 0; j < 4; ++j) {
+			m[j] = _mm_add_ps(m[j], _mm_mul_ps(translation, _mm_shuffle_ps(m[j], m[j], _MM_SHUFFLE(3, 3, 3, 3))));
+		}
+		// Bottom row of the normal matrix minus the translation-weighted upper rows
+		_MM_TRANSPOSE4_PS(n[0], n[1], n[2], n[3]);
+		n[3] = _mm_sub_ps(n[3], _mm_mul_ps(_mm_set1_ps(t.x()), n[0]));
+		n[3] = _mm_sub_ps(n[3], _mm_mul_ps(_mm_set1_ps(t.y()), n[1]));
+		n[3] = _mm_sub_ps(n[3], _mm_mul_ps(_mm_set1_ps(t.z()), n[2]));
+		_MM_TRANSPOSE4_PS(n[0], n[1], n[2], n[3]);
+
+		float* target = &data[off + c * size];
+		if (stream) {
+			for (int j = 0; j < 4; ++j) {
+				_mm_stream_ps(&target[j * 4], m[j]);
+				_mm_stream_ps(&target[16 + j * 4], n[j]);
+			}
+		}
+		else {
+			for (int j = 0; j < 4; ++j) {
+				_mm_storeu_ps(&target[j * 4], m[j]);
+				_mm_storeu_ps(&target[16 + j * 4], n[j]);
+			}
+		}
+	}
+	if (stream) _mm_sfence();
+#else
+	for (int c = 0; c < count; ++c) {
+		int i = indices == nullptr ? c : indices[c];
+		float s = scales == nullptr ? 1.0f : scales[i];
+		mat4 R = rotations == nullptr ? mat4::Identity() : rotations[i];
+		const vec3& t = translations[i];
+		mat4 M = mat4::Translation(t.x(), t.y(), t.z()) * R * mat4::Scale(s, s, s) * local;
+		mat4 N = R * mat4::Scale(1.0f / s, 1.0f / s, 1.0f / s) * localN;
+		for (int col = 0; col < 4; ++col) {
+			N.Set(3, col, N.get(3, col) - t.x() * N.get(0, col) - t.y() * N.get(1, col) - t.z() * N.get(2, col));
+		}
+		setMatrix(data, c, off, size, M);
+		setMatrix(data, c, off + 16, size, N);
+	}
+#endif
+}
+
+int packColor(float red, float green, float blue, float alpha) {
+	int r = (int)(Kore::max(0.0f, Kore::min(red, 1.0f)) * 255);
+	int g = (int)(Kore::max(0.0f, Kore::min(green, 1.0f)) * 255);
+	int b = (int)(Kore::max(0.0f, Kore::min(blue, 1.0f)) * 255);
+	int a = (int)(Kore::max(0.0f, Kore::min(alpha, 1.0f)) * 255);
+#ifdef OPENGL
+	return a << 24 | b << 16 | g << 8 | r;
+#else
+	return a << 24 | r << 16 | g << 8 | b;
+#endif
 }
\ No newline at end of file
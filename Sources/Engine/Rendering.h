@@ -1,6 +1,6 @@
 #pragma once
 
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 #include "ObjLoader.h"
 
 Kore::mat4 calculateN(Kore::mat4 MV);
@@ -8,3 +8,12 @@ void setVertex(float* vertices, int index, float x, float y, float z, float u, f
 void setVertexFromMesh(float* vertices, int index, Mesh* mesh);
 void setVec4(float* data, int instanceIndex, int off, int size, Kore::vec4 v);
 void setMatrix(float* data, int instanceIndex, int off, int size, Kore::mat4 m);
+
+// Writes model matrices M = Translation(translations[i]) * rotations[i] * Scale(scales[i]) * local
+// at off and their normal matrices at off + 16 for count instances. rotations have to be pure
+// rotations, nullptr rotations or scales stand for identity and 1, indices picks the instances
+// from the arrays (nullptr takes the first count).
+void setTransforms(float* data, int off, int size, const Kore::vec3* translations, const Kore::mat4* rotations, const float* scales, const int* indices, int count, Kore::mat4 local);
+
+// A texel as it has to be written into a locked RGBA32 texture
+int packColor(float red, float green, float blue, float alpha);
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "SelfTest.h"
+
+#include <Kore/Log.h>
+#include <Kore/Math/Core.h>
+#include <Kore/Math/Matrix.h>
+
+#include "Rendering.h"
+#include "SimpleGraphics.h"
+
+using namespace Kore;
+
+namespace {
+	// Relative to the largest element of the expected matrix
+	const float tolerance = 1e-4f;
+
+	bool matricesMatch(const char* name, mat4 actual, mat4 expected) {
+		float largest = 0;
+		for (int i = 0; i < 16; ++i) largest = Kore::max(largest, Kore::abs(expected.data[i]));
+		for (int i = 0; i < 16; ++i) {
+			if (Kore::abs(actual.data[i] - expected.data[i]) > tolerance * Kore::max(largest, 1.0f)) {
+				log(Error, "%s: element %i is %f, expected %f", name, i, actual.data[i], expected.data[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool testCalculateN() {
+		struct Case {
+			const char* name;
+			mat4 M;
+		};
+		mat4 R = mat4::Rotation(0.3f, 1.2f, -0.7f);
+		mat4 T = mat4::Translation(3.0f, -2.0f, 15.0f);
+		Case cases[] = {
+			{ "identity", mat4::Identity() },
+			{ "rotation", R },
+			{ "translated rotation", T * R },
+			{ "uniform scale", T * R * mat4::Scale(0.02f, 0.02f, 0.02f) },
+			{ "non-uniform scale", T * R * mat4::Scale(2.0f, 0.5f, 3.0f) },
+			// Not orthogonal, takes the general inverse
+			{ "shear", T * mat4::Scale(2.0f, 0.5f, 3.0f) * R },
+		};
+		bool passed = true;
+		for (const Case& c : cases) {
+			passed = matricesMatch(c.name, calculateN(c.M), c.M.Invert().Transpose()) && passed;
+		}
+		return passed;
+	}
+
+	mat4 readMatrix(const float* data) {
+		mat4 m;
+		for (int i = 0; i < 16; ++i) m.data[i] = data[i];
+		return m;
+	}
+
+	// setTransforms against setMatrix(M) and setMatrix(calculateN(M)) per instance,
+	// below and above the count where it streams past the cache
+	bool testSetTransforms() {
+		const int instanceCount = 300;
+		const int size = 36;
+		vec3 translations[instanceCount];
+		mat4 rotations[instanceCount];
+		float scales[instanceCount];
+		int indices[instanceCount];
+		for (int i = 0; i < instanceCount; ++i) {
+			translations[i] = vec3(i * 0.1f - 15.0f, i * 0.01f, -i * 0.2f);
+			rotations[i] = mat4::RotationY(i * 0.1f) * mat4::RotationX(i * 0.03f);
+			scales[i] = 0.5f + (i % 7) * 0.25f;
+			indices[i] = (i * 7) % instanceCount;
+		}
+		mat4 local = mat4::RotationY(pi) * mat4::Scale(0.02f, 0.02f, 0.02f);
+		float* data = new float[instanceCount * size];
+		float* expected = new float[instanceCount * size];
+
+		struct Case {
+			const char* name;
+			int count;
+			const mat4* rotations;
+			const float* scales;
+			const int* indices;
+		};
+		Case cases[] = {
+			{ "setTransforms translated", 10, nullptr, nullptr, nullptr },
+			{ "setTransforms rotated", 10, rotations, nullptr, nullptr },
+			{ "setTransforms scaled", 10, rotations, scales, nullptr },
+			{ "setTransforms indexed", 10, rotations, scales, indices },
+			{ "setTransforms streamed translated", instanceCount, nullptr, nullptr, nullptr },
+			{ "setTransforms streamed scaled", instanceCount, rotations, scales, nullptr },
+			{ "setTransforms streamed indexed", instanceCount, nullptr, scales, indices },
+			{ "setTransforms streamed indexed rotated", instanceCount, rotations, scales, indices },
+		};
+		bool passed = true;
+		for (const Case& c : cases) {
+			for (int i = 0; i < c.count; ++i) {
+				int instance = c.indices == nullptr ? i : c.indices[i];
+				const vec3& t = translations[instance];
+				mat4 M = mat4::Translation(t.x(), t.y(), t.z());
+				if (c.rotations != nullptr) M *= c.rotations[instance];
+				if (c.scales != nullptr) M *= mat4::Scale(c.scales[instance], c.scales[instance], c.scales[instance]);
+				M *= local;
+				setMatrix(expected, i, 0, size, M);
+				setMatrix(expected, i, 16, size, calculateN(M));
+			}
+			setTransforms(data, 0, size, translations, c.rotations, c.scales, c.indices, c.count, local);
+			for (int i = 0; i < c.count; ++i) {
+				if (!matricesMatch(c.name, readMatrix(&data[i * size]), readMatrix(&expected[i * size]))
+					|| !matricesMatch(c.name, readMatrix(&data[i * size + 16]), readMatrix(&expected[i * size + 16]))) {
+					log(Error, "%s: instance %i of %i differs", c.name, i, c.count);
+					passed = false;
+					break;
+				}
+			}
+		}
+
+		delete[] expected;
+		delete[] data;
+		return passed;
+	}
+}
+
+bool runSelfTests() {
+	bool passed = true;
+	if (!testCalculateN()) {
+		log(Error, "calculateN differs from the inverse transpose");
+		passed = false;
+	}
+	if (!testSetTransforms()) {
+		log(Error, "setTransforms differs from setMatrix per instance");
+		passed = false;
+	}
+	if (!testTriangles()) {
+		log(Error, "The triangle rasterizer draws other pixels than expected");
+		passed = false;
+	}
+	if (!testPixelRows()) {
+		log(Error, "The SSE2 pixel rows differ from the scalar ones");
+		passed = false;
+	}
+	log(Info, "Self tests %s", passed ? "passed" : "failed");
+	return passed;
+}
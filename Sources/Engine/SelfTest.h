@@ -0,0 +1,5 @@
+#pragma once
+
+// Checks of the fast paths against their straightforward versions, for the headless
+// build's --selftest. Logs every mismatch and returns whether all checks passed.
+bool runSelfTests();
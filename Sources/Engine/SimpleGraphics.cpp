@@ -1,15 +1,35 @@
 #include "pch.h"
 #include "SimpleGraphics.h"
 #include <Kore/IO/FileReader.h>
-#include <Kore/Graphics/Graphics.h>
-#include <Kore/Graphics/Shader.h>
+#include "Graphics.h"
 #include <Kore/IO/FileReader.h>
+#include <Kore/Math/Core.h>
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <cmath>
 #include <limits>
+#include <string.h>
+#include <vector>
+
+#include "JobSystem.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMPLEGRAPHICS_AVX
+#define SIMPLEGRAPHICS_SSE2
+#define SIMPLEGRAPHICS_SSSE3
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define SIMPLEGRAPHICS_SSE
+#define SIMPLEGRAPHICS_SSE2
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define SIMPLEGRAPHICS_SSSE3
+#endif
+#endif
 
 using namespace Kore;
 
-//void shadePixel(int x, int y, float z, float u, float v);
-
 namespace {
 	Shader* vertexShader;
 	Shader* fragmentShader;
@@ -19,6 +39,355 @@ namespace {
 	IndexBuffer* ib;
 	Texture* texture;
 	int* image;
+	// Pixels from one row of image to the next
+	int pitch;
+
+	// Screen tiles are drawn in parallel, each by one thread in submission order
+	const int tileSize = 64;
+	const int tilesX = (width + tileSize - 1) / tileSize;
+	const int tilesY = (height + tileSize - 1) / tileSize;
+	static_assert(width % 8 == 0, "rows are drawn eight pixels at a time");
+
+	// Eight pixels of a row at once
+#if defined(SIMPLEGRAPHICS_AVX)
+	struct Lanes {
+		__m256 v;
+	};
+
+	Lanes lanes(float value) { return { _mm256_set1_ps(value) }; }
+	Lanes load(const float* values) { return { _mm256_loadu_ps(values) }; }
+	void store(float* values, Lanes a) { _mm256_storeu_ps(values, a.v); }
+	Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+	Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	Lanes operator/(Lanes a, Lanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+	Lanes operator&(Lanes a, Lanes b) { return { _mm256_and_ps(a.v, b.v) }; }
+	Lanes greater(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+	Lanes greaterEqual(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+	Lanes select(Lanes mask, Lanes a, Lanes b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+	int bits(Lanes mask) { return _mm256_movemask_ps(mask.v); }
+#elif defined(SIMPLEGRAPHICS_SSE)
+	struct Lanes {
+		__m128 low, high;
+	};
+
+	Lanes lanes(float value) { return { _mm_set1_ps(value), _mm_set1_ps(value) }; }
+	Lanes load(const float* values) { return { _mm_loadu_ps(values), _mm_loadu_ps(values + 4) }; }
+	void store(float* values, Lanes a) { _mm_storeu_ps(values, a.low); _mm_storeu_ps(values + 4, a.high); }
+	Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.low, b.low), _mm_add_ps(a.high, b.high) }; }
+	Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.low, b.low), _mm_mul_ps(a.high, b.high) }; }
+	Lanes operator/(Lanes a, Lanes b) { return { _mm_div_ps(a.low, b.low), _mm_div_ps(a.high, b.high) }; }
+	Lanes operator&(Lanes a, Lanes b) { return { _mm_and_ps(a.low, b.low), _mm_and_ps(a.high, b.high) }; }
+	Lanes greater(Lanes a, Lanes b) { return { _mm_cmpgt_ps(a.low, b.low), _mm_cmpgt_ps(a.high, b.high) }; }
+	Lanes greaterEqual(Lanes a, Lanes b) { return { _mm_cmpge_ps(a.low, b.low), _mm_cmpge_ps(a.high, b.high) }; }
+	Lanes select(Lanes mask, Lanes a, Lanes b) {
+		return { _mm_or_ps(_mm_and_ps(mask.low, a.low), _mm_andnot_ps(mask.low, b.low)), _mm_or_ps(_mm_and_ps(mask.high, a.high), _mm_andnot_ps(mask.high, b.high)) };
+	}
+	int bits(Lanes mask) { return _mm_movemask_ps(mask.low) | _mm_movemask_ps(mask.high) << 4; }
+#else
+	// Masks are 1 or 0 per lane
+	struct Lanes {
+		float v[8];
+	};
+
+	Lanes lanes(float value) { Lanes r; for (int i = 0; i < 8; ++i) r.v[i] = value; return r; }
+	Lanes load(const float* values) { Lanes r; for (int i = 0; i < 8; ++i) r.v[i] = values[i]; return r; }
+	void store(float* values, Lanes a) { for (int i = 0; i < 8; ++i) values[i] = a.v[i]; }
+	Lanes operator+(Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] += b.v[i]; return a; }
+	Lanes operator*(Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] *= b.v[i]; return a; }
+	Lanes operator/(Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] /= b.v[i]; return a; }
+	Lanes operator&(Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] *= b.v[i]; return a; }
+	Lanes greater(Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] = a.v[i] > b.v[i] ? 1.0f : 0.0f; return a; }
+	Lanes greaterEqual(Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] = a.v[i] >= b.v[i] ? 1.0f : 0.0f; return a; }
+	Lanes select(Lanes mask, Lanes a, Lanes b) { for (int i = 0; i < 8; ++i) a.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i]; return a; }
+	int bits(Lanes mask) { int r = 0; for (int i = 0; i < 8; ++i) r |= (mask.v[i] != 0 ? 1 : 0) << i; return r; }
+#endif
+
+	const float laneOffsets[8] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+
+	// dx * (x - originX) + dy * (y - originY) + c, relative to the first vertex to keep the precision
+	struct Plane {
+		float dx, dy, c;
+	};
+
+	Lanes at(const Plane& plane, Lanes x, float y) {
+		return lanes(plane.dx) * x + lanes(plane.dy * y + plane.c);
+	}
+
+	struct Triangle {
+		float originX, originY;
+		// Positive inside, edges[k] is the one opposite of vertex k
+		Plane edges[3];
+		// Pixels exactly on an edge belong to the triangle to its right or below it
+		bool topLeft[3];
+		// Linear in screen space, u and v are divided by the interpolated 1 / z
+		Plane invZ, uOverZ, vOverZ;
+		int minX, minY, maxX, maxY;
+		Image* image;
+	};
+
+	Image* boundImage = nullptr;
+	// 1 / z, bigger is nearer
+	float* depth;
+	JobSystem* jobs;
+	std::vector<Triangle> triangles;
+	std::vector<int> bins[tilesX * tilesY];
+
+	Plane planeOf(const Triangle& triangle, float area, float value0, float value1, float value2) {
+		const Plane* e = triangle.edges;
+		Plane plane;
+		plane.dx = (value0 * e[0].dx + value1 * e[1].dx + value2 * e[2].dx) / area;
+		plane.dy = (value0 * e[0].dy + value1 * e[1].dy + value2 * e[2].dy) / area;
+		plane.c = value0;
+		return plane;
+	}
+
+	Lanes inside(const Triangle& triangle, int edge, Lanes x, float y) {
+		Lanes w = at(triangle.edges[edge], x, y);
+		return triangle.topLeft[edge] ? greaterEqual(w, lanes(0.0f)) : greater(w, lanes(0.0f));
+	}
+
+	// Whether any pixel center of the tile can be inside all three edges
+	bool touches(const Triangle& triangle, int left, int top) {
+		float x0 = left + 0.5f - triangle.originX;
+		float y0 = top + 0.5f - triangle.originY;
+		float x1 = x0 + tileSize - 1;
+		float y1 = y0 + tileSize - 1;
+		for (int k = 0; k < 3; ++k) {
+			const Plane& edge = triangle.edges[k];
+			if (edge.dx * (edge.dx > 0 ? x1 : x0) + edge.dy * (edge.dy > 0 ? y1 : y0) + edge.c < 0) return false;
+		}
+		return true;
+	}
+
+	// Images are RGBA in memory, the framebuffer is BGRA outside of OpenGL
+	int toFramebufferOrder(int col) {
+#ifdef OPENGL
+		return col;
+#else
+		return (col & 0xff00ff00) | (col & 0xff) << 16 | ((col >> 16) & 0xff);
+#endif
+	}
+
+	int toFramebuffer(int col) {
+#ifdef OPENGL
+		return col;
+#else
+		return (int)0xff000000 | toFramebufferOrder(col);
+#endif
+	}
+
+	// Source over target by the source's alpha, the result is opaque
+	int blendPixel(int target, int source) {
+		int col = toFramebufferOrder(source);
+		int alpha = (col >> 24) & 0xff;
+		int result = (int)0xff000000;
+		for (int shift = 0; shift < 24; shift += 8) {
+			// Divided by 255, rounded
+			int value = ((col >> shift) & 0xff) * alpha + ((target >> shift) & 0xff) * (255 - alpha) + 128;
+			result |= ((value + (value >> 8)) >> 8) << shift;
+		}
+		return result;
+	}
+
+	// Rows of pixels, four per SSE2 register
+#ifdef SIMPLEGRAPHICS_SSE2
+	__m128i toFramebufferOrder(__m128i pixels) {
+#if defined(OPENGL)
+		return pixels;
+#elif defined(SIMPLEGRAPHICS_SSSE3)
+		return _mm_shuffle_epi8(pixels, _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+#else
+		__m128i greenAlpha = _mm_and_si128(pixels, _mm_set1_epi32((int)0xff00ff00));
+		__m128i redBlue = _mm_and_si128(pixels, _mm_set1_epi32(0x00ff00ff));
+		return _mm_or_si128(greenAlpha, _mm_or_si128(_mm_slli_epi32(redBlue, 16), _mm_srli_epi32(redBlue, 16)));
+#endif
+	}
+
+	// Two pixels with 16 bit channels
+	__m128i blendChannels(__m128i target, __m128i source) {
+		// Every pixel's alpha in all four of its channels
+		__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+		__m128i value = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(source, alpha), _mm_mullo_epi16(target, inverse)), _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+	}
+#endif
+
+	// One pixel at a time, the SSE2 versions finish their rows with these
+	void fillPixelsScalar(int* pixels, int count, int color) {
+		for (int i = 0; i < count; ++i) pixels[i] = color;
+	}
+
+	void copyPixelsScalar(int* target, const int* source, int count) {
+		for (int i = 0; i < count; ++i) target[i] = toFramebuffer(source[i]);
+	}
+
+	void blendPixelsScalar(int* target, const int* source, int count) {
+		for (int i = 0; i < count; ++i) target[i] = blendPixel(target[i], source[i]);
+	}
+
+	void fillPixels(int* pixels, int count, int color) {
+		int i = 0;
+#ifdef SIMPLEGRAPHICS_SSE2
+		__m128i value = _mm_set1_epi32(color);
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_si128((__m128i*)&pixels[i], value);
+		}
+#endif
+		fillPixelsScalar(&pixels[i], count - i, color);
+	}
+
+	void copyPixels(int* target, const int* source, int count) {
+#ifdef OPENGL
+		memcpy(target, source, count * sizeof(int));
+#else
+		int i = 0;
+#ifdef SIMPLEGRAPHICS_SSE2
+		__m128i opaque = _mm_set1_epi32((int)0xff000000);
+		for (; i + 4 <= count; i += 4) {
+			__m128i pixels = toFramebufferOrder(_mm_loadu_si128((const __m128i*)&source[i]));
+			_mm_storeu_si128((__m128i*)&target[i], _mm_or_si128(pixels, opaque));
+		}
+#endif
+		copyPixelsScalar(&target[i], &source[i], count - i);
+#endif
+	}
+
+	void blendPixels(int* target, const int* source, int count) {
+		int i = 0;
+#ifdef SIMPLEGRAPHICS_SSE2
+		__m128i zero = _mm_setzero_si128();
+		__m128i opaque = _mm_set1_epi32((int)0xff000000);
+		for (; i + 4 <= count; i += 4) {
+			__m128i pixels = toFramebufferOrder(_mm_loadu_si128((const __m128i*)&source[i]));
+			__m128i background = _mm_loadu_si128((const __m128i*)&target[i]);
+			__m128i low = blendChannels(_mm_unpacklo_epi8(background, zero), _mm_unpacklo_epi8(pixels, zero));
+			__m128i high = blendChannels(_mm_unpackhi_epi8(background, zero), _mm_unpackhi_epi8(pixels, zero));
+			_mm_storeu_si128((__m128i*)&target[i], _mm_or_si128(_mm_packus_epi16(low, high), opaque));
+		}
+#endif
+		blendPixelsScalar(&target[i], &source[i], count - i);
+	}
+
+	// Rows of pixels for testPixelRows() and benchmarkPixelRows(), every alpha
+	// value appears in the sources
+	void fillTestRows(int* targets, int* sources, int count) {
+		unsigned random = 12345;
+		for (int i = 0; i < count; ++i) {
+			random = random * 1103515245 + 12345;
+			targets[i] = (int)random;
+			random = random * 1103515245 + 12345;
+			sources[i] = (int)((random >> 8) & 0xffffff) | (i & 0xff) << 24;
+		}
+	}
+
+	bool rowsMatch(const char* name, const int* actual, const int* expected, int count) {
+		for (int i = 0; i < count; ++i) {
+			if (actual[i] != expected[i]) {
+				log(Error, "%s: pixel %i is %08x, expected %08x", name, i, actual[i], expected[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Nearest texel, repeating, v flipped like the meshes' texture coordinates
+	int sample(Image* image, float u, float v) {
+		float fx = u * image->width;
+		float fy = (1.0f - v) * image->height;
+		// Rounding down without calling floorf
+		int x = (int)fx - (fx < (int)fx ? 1 : 0);
+		int y = (int)fy - (fy < (int)fy ? 1 : 0);
+		// Mostly inside already, without the divisions
+		if ((unsigned)x >= (unsigned)image->width) {
+			x %= image->width;
+			if (x < 0) x += image->width;
+		}
+		if ((unsigned)y >= (unsigned)image->height) {
+			y %= image->height;
+			if (y < 0) y += image->height;
+		}
+		return ((int*)image->data)[y * image->width + x];
+	}
+
+	void drawTile(int tile) {
+		int left = (tile % tilesX) * tileSize;
+		int top = (tile / tilesX) * tileSize;
+		int right = min(left + tileSize, width);
+		int bottom = min(top + tileSize, height);
+		const Lanes offsets = load(laneOffsets);
+		for (int t : bins[tile]) {
+			const Triangle& triangle = triangles[t];
+			// Tiles and rows start at multiples of eight, so no lane reaches into the next tile
+			int xMin = max(left, triangle.minX) & ~7;
+			int xMax = min(right, triangle.maxX);
+			int yMin = max(top, triangle.minY);
+			int yMax = min(bottom, triangle.maxY);
+			for (int y = yMin; y < yMax; ++y) {
+				float py = y + 0.5f - triangle.originY;
+				float* depthRow = &depth[y * width];
+				int* pixels = &image[y * pitch];
+				for (int x = xMin; x < xMax; x += 8) {
+					Lanes px = lanes(x - triangle.originX) + offsets;
+					Lanes covered = inside(triangle, 0, px, py) & inside(triangle, 1, px, py) & inside(triangle, 2, px, py);
+					if (bits(covered) == 0) continue;
+
+					Lanes invZ = at(triangle.invZ, px, py);
+					Lanes oldDepth = load(&depthRow[x]);
+					Lanes passed = covered & greater(invZ, oldDepth);
+					int mask = bits(passed);
+					if (mask == 0) continue;
+					store(&depthRow[x], select(passed, invZ, oldDepth));
+
+					if (triangle.image == nullptr) {
+						for (int i = 0; i < 8; ++i) {
+							if (mask & (1 << i)) pixels[x + i] = 0xffffffff;
+						}
+						continue;
+					}
+					Lanes z = lanes(1.0f) / invZ;
+					float u[8], v[8];
+					store(u, at(triangle.uOverZ, px, py) * z);
+					store(v, at(triangle.vOverZ, px, py) * z);
+					for (int i = 0; i < 8; ++i) {
+						if (mask & (1 << i)) pixels[x + i] = toFramebuffer(sample(triangle.image, u[i], v[i]));
+					}
+				}
+			}
+		}
+	}
+
+	// Bins the collected triangles into the tiles they touch and draws the tiles
+	void flushTriangles() {
+		if (triangles.empty()) return;
+		for (int tile = 0; tile < tilesX * tilesY; ++tile) bins[tile].clear();
+		for (int t = 0; t < (int)triangles.size(); ++t) {
+			const Triangle& triangle = triangles[t];
+			for (int ty = triangle.minY / tileSize; ty <= (triangle.maxY - 1) / tileSize; ++ty) {
+				for (int tx = triangle.minX / tileSize; tx <= (triangle.maxX - 1) / tileSize; ++tx) {
+					if (touches(triangle, tx * tileSize, ty * tileSize)) bins[ty * tilesX + tx].push_back(t);
+				}
+			}
+		}
+		jobs->parallelFor(tilesX * tilesY, [](int tile) {
+			drawTile(tile);
+		});
+		triangles.clear();
+	}
+
+	// The part of image that is on the screen, row by row
+	void blit(Image* image, int x, int y, void (*row)(int* target, const int* source, int count)) {
+		flushTriangles();
+		int ystart = max(0, -y);
+		int xstart = max(0, -x);
+		int h = min(image->height, height - y);
+		int w = min(image->width, width - x);
+		if (w <= xstart) return;
+		const int* pixels = (const int*)image->data;
+		for (int yy = ystart; yy < h; ++yy) {
+			row(&::image[(y + yy) * pitch + (x + xstart)], &pixels[yy * image->width + xstart], w - xstart);
+		}
+	}
 }
 
 void startFrame() {
@@ -28,25 +397,28 @@ void startFrame() {
 #define CONVERT_COLORS(red, green, blue) int r = (int)((red) * 255); int g = (int)((green) * 255); int b = (int)((blue) * 255);
 
 void clear(float red, float green, float blue) {
+	triangles.clear();
+	// 0.0f is all zero bits
+	memset(depth, 0, width * height * sizeof(float));
 	CONVERT_COLORS(red, green, blue);
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
 #ifdef OPENGL
-			image[y * texture->width + x] = 0xff << 24 | b << 16 | g << 8 | r;
+	int color = 0xff << 24 | b << 16 | g << 8 | r;
 #else
-			image[y * texture->width + x] = 0xff << 24 | r << 16 | g << 8 | b;
+	int color = 0xff << 24 | r << 16 | g << 8 | b;
 #endif
-		}
+	for (int y = 0; y < height; ++y) {
+		fillPixels(&image[y * pitch], width, color);
 	}
 }
 
 void setPixel(int x, int y, float red, float green, float blue) {
 	if (x < 0 || x >= width || y < 0 || y >= height) return;
+	flushTriangles();
 	CONVERT_COLORS(red, green, blue);
 #ifdef OPENGL
-	image[y * texture->width + x] = 0xff << 24 | b << 16 | g << 8 | r;
+	image[y * pitch + x] = 0xff << 24 | b << 16 | g << 8 | r;
 #else
-	image[y * texture->width + x] = 0xff << 24 | r << 16 | g << 8 | b;
+	image[y * pitch + x] = 0xff << 24 | r << 16 | g << 8 | b;
 #endif
 }
 
@@ -59,23 +431,11 @@ void destroyImage(Kore::Image* image) {
 }
 
 void drawImage(Image* image, int x, int y) {
-	int ystart = max(0, -y);
-	int xstart = max(0, -x);
-	int h = min(image->height, height - y);
-	int w = min(image->width, width - x);
-	for (int yy = ystart; yy < h; ++yy) {
-		for (int xx = xstart; xx < w; ++xx) {
-			int col = image->at(xx, yy);
-#ifdef OPENGL
-			::image[(y + yy) * texture->width + (x + xx)] = col;
-#else
-			::image[(y + yy) * texture->width + (x + xx)] = 0xff << 24
-				| ((col >> 0) & 0xff) << 16
-				| ((col >> 8) & 0xff) << 8
-				| ((col >> 16) & 0xff);
-#endif
-		}
-	}
+	blit(image, x, y, copyPixels);
+}
+
+void drawImageBlended(Image* image, int x, int y) {
+	blit(image, x, y, blendPixels);
 }
 
 void getPixel(Image* image, int x, int y, float& red, float& green, float& blue) {
@@ -85,160 +445,55 @@ void getPixel(Image* image, int x, int y, float& red, float& green, float& blue)
 	red = (col & 0xff) / 255.0f;
 }
 
-namespace {
-	struct Edge {
-		int x1, y1, x2, y2;
-		float z1, z2;
-		float u1, v1, u2, v2;
-
-		Edge(int x1, int y1, float z1, float u1, float v1, int x2, int y2, float z2, float u2, float v2) {
-			if (y1 < y2) {
-				this->x1 = x1;
-				this->y1 = y1;
-				this->z1 = z1;
-				this->u1 = u1;
-				this->v1 = v1;
-				this->x2 = x2;
-				this->y2 = y2;
-				this->z2 = z2;
-				this->u2 = u2;
-				this->v2 = v2;
-			}
-			else {
-				this->x1 = x2;
-				this->y1 = y2;
-				this->z1 = z2;
-				this->u1 = u2;
-				this->v1 = v2;
-				this->x2 = x1;
-				this->y2 = y1;
-				this->z2 = z1;
-				this->u2 = u1;
-				this->v2 = v1;
-			}
-		}
-	};
-
-	struct Span {
-		int x1, x2;
-		float z1, z2;
-		float u1, u2;
-		float v1, v2;
-
-		Span(int x1, int x2, float z1, float z2, float u1, float u2, float v1, float v2) {
-			if (x1 < x2) {
-				this->x1 = x1;
-				this->x2 = x2;
-				this->z1 = z1;
-				this->z2 = z2;
-				this->u1 = u1;
-				this->v1 = v1;
-				this->u2 = u2;
-				this->v2 = v2;
-			}
-			else {
-				this->x1 = x2;
-				this->x2 = x1;
-				this->z1 = z2;
-				this->z2 = z1;
-				this->u1 = u2;
-				this->v1 = v2;
-				this->u2 = u1;
-				this->v2 = v1;
-			}
-		}
-	};
-
-	void drawSpan(const Span& span, int y) {
-		int xdiff = span.x2 - span.x1;
-		if (xdiff == 0) return;
-
-		float zdiff = span.z2 - span.z1;
-		float udiff = span.u2 - span.u1;
-		float vdiff = span.v2 - span.v1;
-
-		float factor = 0.0f;
-		float factorStep = 1.0f / xdiff;
-
-		int xMin = max(0, span.x1);
-		int xMax = min(span.x2, width);
-
-		factor += factorStep * -min(0, span.x1);
-
-		for (int x = xMin; x < xMax; ++x) {
-			float z = span.z1 + zdiff * factor;
-			float u = span.u1 + udiff * factor;
-			float v = span.v1 + vdiff * factor;
-			//shadePixel(x, y, z, u, 1 - v);
-			factor += factorStep;
-		}
-	}
-
-	void drawSpansBetweenEdges(const Edge& e1, const Edge& e2) {
-		float e1ydiff = (float)(e1.y2 - e1.y1);
-		if (e1ydiff == 0.0f) return;
-
-		float e2ydiff = (float)(e2.y2 - e2.y1);
-		if (e2ydiff == 0.0f) return;
-
-		float e1xdiff = (float)(e1.x2 - e1.x1);
-		float e2xdiff = (float)(e2.x2 - e2.x1);
-		float z1diff = e1.z2 - e1.z1;
-		float z2diff = e2.z2 - e2.z1;
-		float e1udiff = e1.u2 - e1.u1;
-		float e1vdiff = e1.v2 - e1.v1;
-		float e2udiff = e2.u2 - e2.u1;
-		float e2vdiff = e2.v2 - e2.v1;
-
-		float factor1 = (float)(e2.y1 - e1.y1) / e1ydiff;
-		float factorStep1 = 1.0f / e1ydiff;
-		float factor2 = 0.0f;
-		float factorStep2 = 1.0f / e2ydiff;
-
-		int yMin = max(0, e2.y1);
-		int yMax = min(e2.y2, height);
-
-		factor1 += factorStep1 * -min(0, e2.y1);
-		factor2 += factorStep2 * -min(0, e2.y1);
-
-		for (int y = yMin; y < yMax; ++y) {
-			Span span(e1.x1 + (int)(e1xdiff * factor1), e2.x1 + (int)(e2xdiff * factor2),
-				e1.z1 + z1diff * factor1, e2.z1 + z2diff * factor2,
-				e1.u1 + e1udiff * factor1, e2.u1 + e2udiff * factor2,
-				e1.v1 + e1vdiff * factor1, e2.v1 + e2vdiff * factor2);
-			drawSpan(span, y);
-			factor1 += factorStep1;
-			factor2 += factorStep2;
-		}
-	}
+void setTexture(Image* image) {
+	boundImage = image;
 }
 
 void drawTriangle(float x1, float y1, float z1, float u1, float v1, float x2, float y2, float z2, float u2, float v2, float x3, float y3, float z3, float u3, float v3) {
-	Edge edges[3] = {
-		Edge((int)Kore::round(x1), (int)Kore::round(y1), z1, u1, v1, (int)Kore::round(x2), (int)Kore::round(y2), z2, u2, v2),
-		Edge((int)Kore::round(x2), (int)Kore::round(y2), z2, u2, v2, (int)Kore::round(x3), (int)Kore::round(y3), z3, u3, v3),
-		Edge((int)Kore::round(x3), (int)Kore::round(y3), z3, u3, v3, (int)Kore::round(x1), (int)Kore::round(y1), z1, u1, v1)
-	};
-
-	int maxLength = 0;
-	int longEdge = 0;
-
-	for (int i = 0; i < 3; ++i) {
-		int length = edges[i].y2 - edges[i].y1;
-		if (length > maxLength) {
-			maxLength = length;
-			longEdge = i;
+	if (z1 <= 0 || z2 <= 0 || z3 <= 0) return;
+	float x[3] = { x1, x2, x3 };
+	float y[3] = { y1, y2, y3 };
+
+	Triangle triangle;
+	triangle.originX = x1;
+	triangle.originY = y1;
+	for (int k = 0; k < 3; ++k) {
+		int i = (k + 1) % 3;
+		int j = (k + 2) % 3;
+		Plane& edge = triangle.edges[k];
+		edge.dx = y[i] - y[j];
+		edge.dy = x[j] - x[i];
+		edge.c = edge.dx * (x1 - x[i]) + edge.dy * (y1 - y[i]);
+	}
+	// Twice the signed area, every edge function is that at its opposite vertex
+	float area = triangle.edges[0].c;
+	if (area == 0) return;
+	for (int k = 0; k < 3; ++k) {
+		Plane& edge = triangle.edges[k];
+		if (area < 0) {
+			edge.dx = -edge.dx;
+			edge.dy = -edge.dy;
+			edge.c = -edge.c;
 		}
+		triangle.topLeft[k] = edge.dx > 0 || (edge.dx == 0 && edge.dy > 0);
 	}
-
-	int shortEdge1 = (longEdge + 1) % 3;
-	int shortEdge2 = (longEdge + 2) % 3;
-
-	drawSpansBetweenEdges(edges[longEdge], edges[shortEdge1]);
-	drawSpansBetweenEdges(edges[longEdge], edges[shortEdge2]);
+	area = fabsf(area);
+
+	triangle.invZ = planeOf(triangle, area, 1.0f / z1, 1.0f / z2, 1.0f / z3);
+	triangle.uOverZ = planeOf(triangle, area, u1 / z1, u2 / z2, u3 / z3);
+	triangle.vOverZ = planeOf(triangle, area, v1 / z1, v2 / z2, v3 / z3);
+
+	triangle.minX = max(0, (int)floorf(min(x1, min(x2, x3))));
+	triangle.minY = max(0, (int)floorf(min(y1, min(y2, y3))));
+	triangle.maxX = min(width, (int)ceilf(max(x1, max(x2, x3))));
+	triangle.maxY = min(height, (int)ceilf(max(y1, max(y2, y3))));
+	if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY) return;
+	triangle.image = boundImage;
+	triangles.push_back(triangle);
 }
 
 void endFrame() {
+	flushTriangles();
 	texture->unlock();
 
 	Graphics::begin();
@@ -257,6 +512,163 @@ void endFrame() {
 	Graphics::swapBuffers();
 }
 
+bool testPixelRows() {
+	// Not a multiple of four so the scalar tails are covered too
+	const int count = 4099;
+	int* targets = new int[count];
+	int* sources = new int[count];
+	int* actual = new int[count];
+	int* expected = new int[count];
+	fillTestRows(targets, sources, count);
+	bool passed = true;
+
+	fillPixels(actual, count, sources[7]);
+	fillPixelsScalar(expected, count, sources[7]);
+	passed &= rowsMatch("fillPixels", actual, expected, count);
+
+	copyPixels(actual, sources, count);
+	copyPixelsScalar(expected, sources, count);
+	passed &= rowsMatch("copyPixels", actual, expected, count);
+
+	memcpy(actual, targets, count * sizeof(int));
+	memcpy(expected, targets, count * sizeof(int));
+	blendPixels(actual, sources, count);
+	blendPixelsScalar(expected, sources, count);
+	passed &= rowsMatch("blendPixels", actual, expected, count);
+
+	delete[] expected;
+	delete[] actual;
+	delete[] sources;
+	delete[] targets;
+	return passed;
+}
+
+bool testTriangles() {
+	// Draws into buffers of its own, the window's framebuffer may not exist
+	int* frameImage = image;
+	float* frameDepth = depth;
+	int framePitch = pitch;
+	Image* frameBoundImage = boundImage;
+	image = new int[width * height];
+	depth = new float[width * height];
+	pitch = width;
+	if (jobs == nullptr) jobs = new JobSystem;
+	const int white = (int)0xffffffff;
+	const int black = (int)0xff000000;
+	bool passed = true;
+
+	// The two halves of a square with its corners on pixel centers. Every center on the diagonal
+	// goes to exactly one of them, the ones on the right and bottom edges to neither.
+	bool* first = new bool[width * height];
+	setTexture(nullptr);
+	clear(0, 0, 0);
+	drawTriangle(8.5f, 8.5f, 2, 0, 0, 8.5f, 24.5f, 2, 0, 0, 24.5f, 24.5f, 2, 0, 0);
+	flushTriangles();
+	for (int i = 0; i < width * height; ++i) first[i] = image[i] == white;
+	clear(0, 0, 0);
+	drawTriangle(8.5f, 8.5f, 2, 0, 0, 24.5f, 24.5f, 2, 0, 0, 24.5f, 8.5f, 2, 0, 0);
+	flushTriangles();
+	for (int i = 0; i < width * height && passed; ++i) {
+		int x = i % width;
+		int y = i / width;
+		bool second = image[i] == white;
+		bool inside = x >= 8 && x < 24 && y >= 8 && y < 24;
+		if ((first[i] && second) || (first[i] || second) != inside) {
+			log(Error, "drawTriangle: pixel %i, %i is covered %s, expected %s", x, y, first[i] && second ? "twice" : first[i] || second ? "once" : "never", inside ? "once" : "never");
+			passed = false;
+		}
+	}
+	delete[] first;
+
+	// A textured square in front of a white triangle drawn before it and one drawn after it,
+	// texels of the 2x2 checker are in image order with v pointing up
+	Image* checker = new Image(2, 2, Image::RGBA32, true);
+	const int texels[4] = { (int)0xff0000ff, (int)0xff00ff00, (int)0xffff0000, (int)0xff00ffff };
+	memcpy(checker->data, texels, sizeof(texels));
+	clear(0, 0, 0);
+	drawTriangle(90, 90, 10, 0, 0, 90, 200, 10, 0, 0, 200, 90, 10, 0, 0);
+	setTexture(checker);
+	drawTriangle(100, 100, 2, 0, 1, 100, 164, 2, 0, 0, 164, 164, 2, 1, 0);
+	drawTriangle(100, 100, 2, 0, 1, 164, 164, 2, 1, 0, 164, 100, 2, 1, 1);
+	setTexture(nullptr);
+	drawTriangle(200, 90, 5, 0, 0, 90, 200, 5, 0, 0, 200, 200, 5, 0, 0);
+	flushTriangles();
+	for (int y = 80; y < 210 && passed; ++y) {
+		for (int x = 80; x < 210; ++x) {
+			int expected = black;
+			if (x >= 100 && x < 164 && y >= 100 && y < 164) expected = toFramebuffer(texels[(y < 132 ? 0 : 2) + (x < 132 ? 0 : 1)]);
+			else if (x >= 90 && x < 200 && y >= 90 && y < 200) expected = white;
+			if (image[y * pitch + x] != expected) {
+				log(Error, "drawTriangle: pixel %i, %i is %08x, expected %08x", x, y, image[y * pitch + x], expected);
+				passed = false;
+				break;
+			}
+		}
+	}
+	delete checker;
+
+	delete[] depth;
+	delete[] image;
+	image = frameImage;
+	depth = frameDepth;
+	pitch = framePitch;
+	boundImage = frameBoundImage;
+	return passed;
+}
+
+bool benchmarkPixelRows() {
+	const int repetitions = 20;
+	const int count = width * height;
+	int* targets = new int[count];
+	int* sources = new int[count];
+	int* pixels = new int[count];
+	fillTestRows(targets, sources, count);
+	typedef void (*Fill)(int* pixels, int count, int color);
+	typedef void (*Row)(int* target, const int* source, int count);
+	Fill fills[2] = { fillPixels, fillPixelsScalar };
+	Row copies[2] = { copyPixels, copyPixelsScalar };
+	Row blends[2] = { blendPixels, blendPixelsScalar };
+	double times[3][2];
+	int check = 0;
+	for (int path = 0; path < 2; ++path) {
+		// A whole frame row by row, like clear() and the blits
+		double start = System::time();
+		for (int r = 0; r < repetitions; ++r) {
+			for (int y = 0; y < height; ++y) fills[path](&pixels[y * width], width, sources[r]);
+		}
+		times[0][path] = System::time() - start;
+		check += pixels[count - 1];
+
+		start = System::time();
+		for (int r = 0; r < repetitions; ++r) {
+			for (int y = 0; y < height; ++y) copies[path](&pixels[y * width], &sources[y * width], width);
+		}
+		times[1][path] = System::time() - start;
+		check += pixels[count - 1];
+
+		memcpy(pixels, targets, count * sizeof(int));
+		start = System::time();
+		for (int r = 0; r < repetitions; ++r) {
+			for (int y = 0; y < height; ++y) blends[path](&pixels[y * width], &sources[y * width], width);
+		}
+		times[2][path] = System::time() - start;
+		check += pixels[count - 1];
+	}
+#ifndef SIMPLEGRAPHICS_SSE2
+	log(Info, "Built without SSE2, both paths are scalar");
+#endif
+	log(Info, "Pixel rows of a %ix%i frame, SSE2 / scalar: clear %f / %f ms, copy %f / %f ms, blend %f / %f ms (checksum %08x)", width, height,
+		times[0][0] * 1000.0 / repetitions, times[0][1] * 1000.0 / repetitions, times[1][0] * 1000.0 / repetitions, times[1][1] * 1000.0 / repetitions,
+		times[2][0] * 1000.0 / repetitions, times[2][1] * 1000.0 / repetitions, check);
+
+	delete[] pixels;
+	delete[] sources;
+	delete[] targets;
+	bool passed = testPixelRows();
+	if (!passed) log(Error, "The SSE2 pixel rows differ from the scalar ones");
+	return passed;
+}
+
 void initGraphics() {
 	FileReader vs("shader.vert");
 	FileReader fs("shader.frag");
@@ -280,6 +692,11 @@ void initGraphics() {
 		}
 	}
 	texture->unlock();
+	pitch = texture->width;
+	depth = new float[width * height];
+	// Far away everywhere until the first clear()
+	memset(depth, 0, width * height * sizeof(float));
+	jobs = new JobSystem;
 
 	vb = new VertexBuffer(4, structure, 0);
 	float* v = vb->lock();
@@ -7,12 +7,27 @@ namespace Kore {
 void initGraphics();
 void startFrame();
 void endFrame();
+// Clears the depth buffer too
 void clear(float red, float green, float blue);
 void setPixel(int x, int y, float red, float green, float blue);
 void getPixel(Kore::Image* image, int x, int y, float& red, float& green, float& blue);
 Kore::Image* loadImage(const char* filename);
 void destroyImage(Kore::Image* image);
 void drawImage(Kore::Image* image, int x, int y);
+// Over what is already there, by the image's alpha
+void drawImageBlended(Kore::Image* image, int x, int y);
+// Textures the following triangles, nullptr draws them white
+void setTexture(Kore::Image* image);
+// x and y in pixels, z the distance from the camera, triangles reaching behind it are skipped.
+// Triangles are collected and drawn depth tested on all threads before the next other drawing call.
 void drawTriangle(float x1, float y1, float z1, float u1, float v1, float x2, float y2, float z2, float u2, float v2, float x3, float y3, float z3, float u3, float v3);
+// Draws a few overlapping triangles into a framebuffer of its own and checks coverage,
+// edge ownership, texturing and depth order pixel by pixel. Not during a frame.
+bool testTriangles();
+// Compares the SSE2 row kernels that clear, copy and blend pixels with the scalar ones
+// pixel by pixel and logs the first difference. Without SSE2 both are the same code.
+bool testPixelRows();
+// Times the SSE2 row kernels against the scalar ones over a frame, then runs testPixelRows()
+bool benchmarkPixelRows();
 const int width = 1024;
 const int height = 768;
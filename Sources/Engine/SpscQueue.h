@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+
+// Fixed size ring buffer between exactly one producing and one consuming thread,
+// without locks. One slot always stays empty to tell a full queue from an empty one.
+template<class T, int size> class SpscQueue {
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// Producer only, false when the queue is full
+	bool push(const T& value) {
+		int t = tail.load(std::memory_order_relaxed);
+		int next = (t + 1) % size;
+		if (next == head.load(std::memory_order_acquire)) return false;
+		items[t] = value;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only, false when the queue is empty
+	bool pop(T& value) {
+		int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		value = items[h];
+		head.store((h + 1) % size, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[size];
+	std::atomic<int> head;
+	std::atomic<int> tail;
+};
@@ -0,0 +1,274 @@
+#include "pch.h"
+#include "StaticBatch.h"
+#include "Frustum.h"
+#include "InstancedMeshObject.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
+#include "TextureAtlas.h"
+
+#include <limits>
+
+using namespace Kore;
+
+namespace {
+	const char* atlasName = "<atlas>";
+
+	bool uvsInside(Mesh* mesh) {
+		const float epsilon = 0.001f;
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			float u = mesh->vertices[i * 8 + 3];
+			float v = mesh->vertices[i * 8 + 4];
+			if (u < -epsilon || u > 1 + epsilon || v < -epsilon || v > 1 + epsilon) return false;
+		}
+		return true;
+	}
+
+	void include(vec3& min, vec3& max, vec3 point) {
+		for (int c = 0; c < 3; ++c) {
+			min[c] = Kore::min(min[c], point[c]);
+			max[c] = Kore::max(max[c], point[c]);
+		}
+	}
+}
+
+StaticBatch::StaticBatch(const VertexStructure& structure, TextureAtlas* atlas) : culled(0), occluded(0), structure(structure), atlas(atlas), instancedStructures(nullptr), instancedProgram(nullptr), minInstances(0) {
+
+}
+
+int StaticBatch::add(MeshObject* mesh, mat4 M) {
+	int atlasEntry = atlas == nullptr ? -1 : atlas->find(mesh->textureFile);
+	if (atlasEntry >= 0 && !uvsInside(mesh->mesh)) atlasEntry = -1;
+	const char* textureFile = atlasEntry >= 0 ? atlasName : mesh->textureFile;
+
+	// Every MeshObject loads its own copy of its texture, so batches go by file name
+	int batch = -1;
+	for (unsigned b = 0; b < batches.size(); ++b) {
+		if (strcmp(batches[b].textureFile, textureFile) == 0) {
+			batch = b;
+			break;
+		}
+	}
+	if (batch < 0) {
+		Batch newBatch;
+		newBatch.textureFile = textureFile;
+		newBatch.image = atlasEntry >= 0 ? atlas->texture : mesh->image;
+		newBatch.vertexBuffer = nullptr;
+		newBatch.indexBuffer = nullptr;
+		newBatch.vertexCount = 0;
+		newBatch.indexCount = 0;
+		batches.push_back(newBatch);
+		batch = (int)batches.size() - 1;
+	}
+
+	Part part;
+	part.mesh = mesh;
+	part.M = M;
+	part.batch = batch;
+	part.group = -1;
+	part.atlasEntry = atlasEntry;
+	part.firstIndex = 0;
+	part.indexCount = mesh->mesh->numFaces * 3;
+	part.visible = true;
+	parts.push_back(part);
+	return (int)parts.size() - 1;
+}
+
+void StaticBatch::instance(VertexStructure** structures, Program* program, TextureUnit tex, int minInstances) {
+	instancedStructures = structures;
+	instancedProgram = program;
+	instancedTex = tex;
+	this->minInstances = minInstances;
+}
+
+void StaticBatch::findGroups() {
+	if (instancedStructures == nullptr) return;
+	for (unsigned p = 0; p < parts.size(); ++p) {
+		if (parts[p].group >= 0) continue;
+		MeshObject* mesh = parts[p].mesh;
+		int count = 0;
+		for (unsigned other = p; other < parts.size(); ++other) {
+			MeshObject* otherMesh = parts[other].mesh;
+			if (strcmp(mesh->meshFile, otherMesh->meshFile) == 0 && strcmp(mesh->textureFile, otherMesh->textureFile) == 0) ++count;
+		}
+		if (count < minInstances) continue;
+
+		Group group;
+		// Every MeshObject loaded its own copy, the first one is drawn for all of them
+		group.mesh = new InstancedMeshObject(mesh->mesh, mesh->image, instancedStructures, count);
+		group.count = count;
+		vec3 min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		vec3 max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+		for (unsigned other = p; other < parts.size(); ++other) {
+			Part& part = parts[other];
+			if (strcmp(mesh->meshFile, part.mesh->meshFile) != 0 || strcmp(mesh->textureFile, part.mesh->textureFile) != 0) continue;
+			part.group = (int)groups.size();
+			part.min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			part.max = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+			vec3 bounds[2] = { part.mesh->boundsMin, part.mesh->boundsMax };
+			for (int corner = 0; corner < 8; ++corner) {
+				vec4 position = part.M * vec4(bounds[corner & 1].x(), bounds[(corner >> 1) & 1].y(), bounds[corner >> 2].z(), 1);
+				include(part.min, part.max, vec3(position.x(), position.y(), position.z()));
+			}
+			include(min, max, part.min);
+			include(min, max, part.max);
+		}
+		group.center = (min + max) * 0.5f;
+		groups.push_back(group);
+	}
+}
+
+void StaticBatch::build() {
+	findGroups();
+	for (unsigned b = 0; b < batches.size(); ++b) {
+		Batch& batch = batches[b];
+		batch.vertexCount = 0;
+		batch.indexCount = 0;
+		for (unsigned p = 0; p < parts.size(); ++p) {
+			Part& part = parts[p];
+			if (part.batch != (int)b || part.group >= 0) continue;
+			part.firstIndex = batch.indexCount;
+			batch.indexCount += part.indexCount;
+			batch.vertexCount += part.mesh->mesh->numVertices;
+		}
+		// Everything of this texture is instanced
+		if (batch.indexCount == 0) continue;
+
+		batch.vertexBuffer = new VertexBuffer(batch.vertexCount, structure, 0);
+		batch.indexBuffer = new IndexBuffer(batch.indexCount);
+		float* vertices = batch.vertexBuffer->lock();
+		int* indices = batch.indexBuffer->lock();
+		int baseVertex = 0;
+		vec3 min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		vec3 max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+		for (unsigned p = 0; p < parts.size(); ++p) {
+			Part& part = parts[p];
+			if (part.batch != (int)b || part.group >= 0) continue;
+			Mesh* mesh = part.mesh->mesh;
+			part.min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			part.max = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+			for (int i = 0; i < mesh->numVertices; ++i) {
+				float* source = &mesh->vertices[i * 8];
+				float* target = &vertices[(baseVertex + i) * 8];
+				vec4 position = part.M * vec4(source[0], source[1], source[2], 1);
+				// Transformed like shader2.vert does with M, which is the identity now
+				vec4 normal = part.M * vec4(source[5], source[6], source[7], 0);
+				target[0] = position.x();
+				target[1] = position.y();
+				target[2] = position.z();
+				include(part.min, part.max, vec3(target[0], target[1], target[2]));
+				float u = source[3];
+				float v = 1.0f - source[4];
+				if (part.atlasEntry >= 0) atlas->map(part.atlasEntry, u, v);
+				target[3] = u;
+				target[4] = v;
+				target[5] = normal.x();
+				target[6] = normal.y();
+				target[7] = normal.z();
+			}
+			for (int i = 0; i < part.indexCount; ++i) {
+				indices[part.firstIndex + i] = baseVertex + mesh->indices[i];
+			}
+			baseVertex += mesh->numVertices;
+			include(min, max, part.min);
+			include(min, max, part.max);
+		}
+		batch.indexBuffer->unlock();
+		batch.vertexBuffer->unlock();
+		batch.center = (min + max) * 0.5f;
+	}
+}
+
+void StaticBatch::render(CommandBuffer& commands, TextureUnit tex, ConstantLocation mLocation) {
+	commands.setMatrix(mLocation, mat4::Identity());
+	for (unsigned b = 0; b < batches.size(); ++b) {
+		if (batches[b].indexCount > 0) renderBatch(commands, b, tex);
+	}
+}
+
+bool StaticBatch::test(Part& part, const Frustum& frustum, const OcclusionBuffer* occlusion) {
+	part.visible = false;
+	if (!frustum.isVisible(part.min, part.max)) ++culled;
+	else if (occlusion != nullptr && !occlusion->isVisible(part.min, part.max)) ++occluded;
+	else part.visible = true;
+	return part.visible;
+}
+
+void StaticBatch::enqueue(RenderQueue* queue, Program* program, TextureUnit tex, ConstantLocation mLocation, const Frustum& frustum, const OcclusionBuffer* occlusion) {
+	culled = 0;
+	occluded = 0;
+	for (unsigned b = 0; b < batches.size(); ++b) {
+		if (batches[b].indexCount == 0) continue;
+		int visible = 0;
+		int count = 0;
+		for (unsigned p = 0; p < parts.size(); ++p) {
+			Part& part = parts[p];
+			if (part.batch != (int)b || part.group >= 0) continue;
+			if (test(part, frustum, occlusion)) ++visible;
+			++count;
+		}
+		if (visible == 0) continue;
+		bool all = visible == count;
+		queue->add(RenderQueue::Opaque, program, batches[b].image, &batches[b], batches[b].center, [this, b, tex, mLocation, all](CommandBuffer& commands) {
+			commands.setMatrix(mLocation, mat4::Identity());
+			if (all) renderBatch(commands, b, tex);
+			else renderVisibleParts(commands, b, tex);
+		});
+	}
+	for (unsigned g = 0; g < groups.size(); ++g) {
+		int visible = 0;
+		for (unsigned p = 0; p < parts.size(); ++p) {
+			Part& part = parts[p];
+			if (part.group != (int)g) continue;
+			if (test(part, frustum, occlusion)) ++visible;
+		}
+		if (visible == 0) continue;
+		queue->add(RenderQueue::Opaque, instancedProgram, groups[g].mesh->image, groups[g].mesh, groups[g].center, [this, g](CommandBuffer& commands) {
+			renderGroup(commands, g);
+		});
+	}
+}
+
+void StaticBatch::renderGroup(CommandBuffer& commands, int group) {
+	InstancedMeshObject* mesh = groups[group].mesh;
+	float* data = mesh->lockInstances();
+	int count = 0;
+	for (unsigned p = 0; p < parts.size(); ++p) {
+		const Part& part = parts[p];
+		if (part.group != group || !part.visible) continue;
+		setMatrix(data, count, 0, 36, part.M);
+		setMatrix(data, count, 16, 36, calculateN(part.M));
+		setVec4(data, count, 32, 36, vec4(1, 1, 1, 1));
+		++count;
+	}
+	mesh->unlockInstances();
+	mesh->render(commands, instancedTex, count);
+}
+
+void StaticBatch::renderVisibleParts(CommandBuffer& commands, int batch, TextureUnit tex) {
+	commands.setTexture(tex, batches[batch].image);
+	commands.setVertexBuffer(batches[batch].vertexBuffer);
+	commands.setIndexBuffer(batches[batch].indexBuffer);
+	// Parts follow each other in the index buffer, neighbouring visible ones go into one draw
+	int start = 0;
+	int count = 0;
+	for (unsigned p = 0; p < parts.size(); ++p) {
+		const Part& part = parts[p];
+		// Instanced parts are not in the batch's index buffer
+		if (part.batch != batch || part.group >= 0 || !part.visible) continue;
+		if (count > 0 && start + count == part.firstIndex) {
+			count += part.indexCount;
+			continue;
+		}
+		if (count > 0) commands.drawIndexedVertices(start, count);
+		start = part.firstIndex;
+		count = part.indexCount;
+	}
+	if (count > 0) commands.drawIndexedVertices(start, count);
+}
+
+void StaticBatch::renderBatch(CommandBuffer& commands, int batch, TextureUnit tex) {
+	commands.setTexture(tex, batches[batch].image);
+	commands.setVertexBuffer(batches[batch].vertexBuffer);
+	commands.setIndexBuffer(batches[batch].indexBuffer);
+	commands.drawIndexedVertices();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "Graphics.h"
+
+#include "MeshObject.h"
+
+class CommandBuffer;
+class Frustum;
+class InstancedMeshObject;
+class OcclusionBuffer;
+class RenderQueue;
+class TextureAtlas;
+
+// Meshes that never move, transformed into world space at load time and merged
+// into one vertex and index buffer per texture. Drawn with an identity model matrix.
+// Meshes whose texture is in the atlas all go into one batch with remapped uvs.
+// Meshes that were added often enough with the same mesh and texture file can be
+// drawn as instances instead, see instance().
+class StaticBatch {
+public:
+	StaticBatch(const Kore::VertexStructure& structure, TextureAtlas* atlas = nullptr);
+
+	// Returns the part's index, only valid before build()
+	int add(MeshObject* mesh, Kore::mat4 M);
+	// Call before build(), structures and program are the ones of shader2_instanced.vert
+	void instance(Kore::VertexStructure** structures, Kore::Program* program, Kore::TextureUnit tex, int minInstances = 3);
+	void build();
+	// Only the merged batches, instanced groups are drawn by enqueue()
+	void render(CommandBuffer& commands, Kore::TextureUnit tex, Kore::ConstantLocation mLocation);
+	// One opaque draw per batch with parts in the frustum, which draws the visible index ranges,
+	// and one instanced draw per group with visible parts. Parts completely behind the occluders
+	// are skipped too unless occlusion is nullptr.
+	void enqueue(RenderQueue* queue, Kore::Program* program, Kore::TextureUnit tex, Kore::ConstantLocation mLocation, const Frustum& frustum, const OcclusionBuffer* occlusion);
+
+	// Where a mesh ended up, its indices are contiguous inside its batch
+	struct Part {
+		MeshObject* mesh;
+		Kore::mat4 M;
+		int batch;
+		// -1 when merged into its batch
+		int group;
+		// -1 when drawn with its own texture
+		int atlasEntry;
+		int firstIndex;
+		int indexCount;
+		// World space bounds
+		Kore::vec3 min;
+		Kore::vec3 max;
+		bool visible;
+	};
+
+	struct Batch {
+		const char* textureFile;
+		Kore::Texture* image;
+		Kore::VertexBuffer* vertexBuffer;
+		Kore::IndexBuffer* indexBuffer;
+		int vertexCount;
+		int indexCount;
+		Kore::vec3 center;
+	};
+
+	// Parts sharing mesh and texture file, drawn with the first part's mesh
+	struct Group {
+		InstancedMeshObject* mesh;
+		int count;
+		Kore::vec3 center;
+	};
+
+	std::vector<Part> parts;
+	std::vector<Batch> batches;
+	std::vector<Group> groups;
+
+	// Parts outside of the frustum in the last enqueue
+	int culled;
+	// Parts in the frustum but behind the occluders in the last enqueue
+	int occluded;
+
+private:
+	// Sets part.visible and counts it as culled or occluded when it is not
+	bool test(Part& part, const Frustum& frustum, const OcclusionBuffer* occlusion);
+	void renderBatch(CommandBuffer& commands, int batch, Kore::TextureUnit tex);
+	void renderVisibleParts(CommandBuffer& commands, int batch, Kore::TextureUnit tex);
+	void renderGroup(CommandBuffer& commands, int group);
+	void findGroups();
+
+	Kore::VertexStructure structure;
+	TextureAtlas* atlas;
+	Kore::VertexStructure** instancedStructures;
+	Kore::Program* instancedProgram;
+	Kore::TextureUnit instancedTex;
+	int minInstances;
+};
@@ -0,0 +1,109 @@
+#include "pch.h"
+#include "TextureAtlas.h"
+
+#include <Kore/Log.h>
+#include <algorithm>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	// Edge texels are repeated around every texture so filtering doesn't pick up the neighbours
+	const int gutter = 2;
+
+	int texel(int rgba) {
+#ifdef OPENGL
+		return rgba;
+#else
+		return (rgba & 0xff00ff00) | ((rgba & 0xff) << 16) | ((rgba >> 16) & 0xff);
+#endif
+	}
+
+	int nextPowerOfTwo(int value) {
+		int power = 1;
+		while (power < value) power *= 2;
+		return power;
+	}
+}
+
+TextureAtlas::TextureAtlas(int width, int maxHeight) : texture(nullptr), width(width), maxHeight(maxHeight) {
+
+}
+
+void TextureAtlas::add(const char* name, Image* image) {
+	for (unsigned e = 0; e < entries.size(); ++e) {
+		if (strcmp(entries[e].name, name) == 0) return;
+	}
+	Entry entry;
+	entry.name = name;
+	entry.image = image;
+	entry.x = entry.y = 0;
+	entry.packed = false;
+	entries.push_back(entry);
+}
+
+void TextureAtlas::build() {
+	// Shelves, filled with the tallest textures first
+	std::vector<int> order;
+	for (unsigned i = 0; i < entries.size(); ++i) order.push_back(i);
+	std::sort(order.begin(), order.end(), [this](int a, int b) { return entries[a].image->height > entries[b].image->height; });
+
+	int shelfY = 0;
+	int shelfHeight = 0;
+	int x = 0;
+	for (unsigned o = 0; o < order.size(); ++o) {
+		Entry& entry = entries[order[o]];
+		int w = entry.image->width + gutter * 2;
+		int h = entry.image->height + gutter * 2;
+		if (w > width) continue;
+		if (x + w > width) {
+			shelfY += shelfHeight;
+			shelfHeight = 0;
+			x = 0;
+		}
+		if (shelfY + h > maxHeight) continue;
+		entry.x = x + gutter;
+		entry.y = shelfY + gutter;
+		entry.packed = true;
+		x += w;
+		shelfHeight = Kore::max(shelfHeight, h);
+	}
+	int height = nextPowerOfTwo(Kore::max(1, shelfY + shelfHeight));
+
+	texture = new Texture(width, height, Image::RGBA32, false);
+	int* pixels = (int*)texture->lock();
+	for (int i = 0; i < texture->texWidth * height; ++i) pixels[i] = 0;
+	int packed = 0;
+	for (unsigned e = 0; e < entries.size(); ++e) {
+		Entry& entry = entries[e];
+		if (!entry.packed) {
+			log(Warning, "%s does not fit into the texture atlas", entry.name);
+			continue;
+		}
+		++packed;
+		Image* image = entry.image;
+		for (int y = -gutter; y < image->height + gutter; ++y) {
+			int sy = Kore::min(image->height - 1, Kore::max(0, y));
+			int* row = &pixels[(entry.y + y) * texture->texWidth + entry.x];
+			for (int x = -gutter; x < image->width + gutter; ++x) {
+				int sx = Kore::min(image->width - 1, Kore::max(0, x));
+				row[x] = texel(image->at(sx, sy));
+			}
+		}
+	}
+	texture->unlock();
+	log(Info, "Texture atlas %i x %i with %i of %i textures", width, height, packed, (int)entries.size());
+}
+
+int TextureAtlas::find(const char* name) const {
+	for (unsigned e = 0; e < entries.size(); ++e) {
+		if (strcmp(entries[e].name, name) == 0) return entries[e].packed ? (int)e : -1;
+	}
+	return -1;
+}
+
+void TextureAtlas::map(int entry, float& u, float& v) const {
+	const Entry& e = entries[entry];
+	u = (e.x + u * e.image->width) / texture->texWidth;
+	v = (e.y + v * e.image->height) / texture->texHeight;
+}
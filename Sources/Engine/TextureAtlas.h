@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "Graphics.h"
+
+// Packs several readable textures into one, so meshes with different textures
+// can share a draw. Only for meshes whose uvs stay inside [0, 1], tiling
+// textures would repeat the whole atlas.
+class TextureAtlas {
+public:
+	TextureAtlas(int width = 4096, int maxHeight = 4096);
+
+	// Textures are told apart by name, adding one twice is fine
+	void add(const char* name, Kore::Image* image);
+	// Packs and uploads, textures that don't fit are left out
+	void build();
+
+	// -1 when the texture is not in the atlas
+	int find(const char* name) const;
+	// Texture coordinates of an entry's texture to coordinates in the atlas
+	void map(int entry, float& u, float& v) const;
+
+	Kore::Texture* texture;
+
+private:
+	struct Entry {
+		const char* name;
+		Kore::Image* image;
+		int x, y;
+		bool packed;
+	};
+
+	std::vector<Entry> entries;
+	int width;
+	int maxHeight;
+};
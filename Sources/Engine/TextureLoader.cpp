@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "TextureLoader.h"
+
+#include "BakedTexture.h"
+#include "JobSystem.h"
+
+#include <Kore/Log.h>
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+
+using namespace Kore;
+
+namespace {
+	struct Entry {
+		Texture* texture;
+		bool readable;
+	};
+
+	std::map<std::string, Entry> textures;
+	bool baking = false;
+
+	// A file on its way through preloadTextures
+	struct Pending {
+		const char* filename;
+		bool baked;
+		// Decoded png when there is no baked file
+		Image* image;
+	};
+
+	// Decodes the png, and bakes it when asked to
+	Image* decode(const char* filename) {
+		Image* image = new Image(filename, true);
+		if (baking) bakeTexture(filename, *image);
+		return image;
+	}
+
+	Texture* upload(const char* filename, Image* image, bool readable) {
+		if (image != nullptr && image->format == Image::RGBA32 && image->data != nullptr) {
+			return createTexture(image->data, image->width, image->height, readable);
+		}
+		return new Texture(filename, readable);
+	}
+}
+
+Texture* loadTexture(const char* filename, bool readable) {
+	std::map<std::string, Entry>::iterator found = textures.find(filename);
+	if (found != textures.end() && (found->second.readable || !readable)) return found->second.texture;
+
+	Texture* texture = loadBakedTexture(filename, readable);
+	if (texture == nullptr && baking) {
+		Image* image = decode(filename);
+		texture = upload(filename, image, readable);
+		delete image;
+	}
+	if (texture == nullptr) texture = new Texture(filename, readable);
+
+	Entry entry;
+	entry.texture = texture;
+	entry.readable = readable;
+	textures[filename] = entry;
+	return texture;
+}
+
+void preloadTextures(const char** filenames, int count, JobSystem* jobs) {
+	std::vector<Pending> pending;
+	for (int i = 0; i < count; ++i) {
+		if (textures.find(filenames[i]) != textures.end()) continue;
+		bool repeated = false;
+		for (unsigned p = 0; p < pending.size(); ++p) {
+			if (strcmp(pending[p].filename, filenames[i]) == 0) repeated = true;
+		}
+		if (repeated) continue;
+		Pending file;
+		file.filename = filenames[i];
+		file.baked = false;
+		file.image = nullptr;
+		pending.push_back(file);
+	}
+
+	// Decoding is what takes the time, the uploads have to stay on this thread anyway
+	jobs->parallelFor((int)pending.size(), [&pending](int p) {
+		Pending& file = pending[p];
+		file.baked = isBaked(file.filename);
+		if (!file.baked) file.image = decode(file.filename);
+	});
+
+	int baked = 0;
+	for (unsigned p = 0; p < pending.size(); ++p) {
+		Pending& file = pending[p];
+		Texture* texture = file.baked ? loadBakedTexture(file.filename, true) : nullptr;
+		if (texture != nullptr) ++baked;
+		else texture = upload(file.filename, file.image, true);
+		delete file.image;
+
+		Entry entry;
+		entry.texture = texture;
+		entry.readable = true;
+		textures[file.filename] = entry;
+	}
+	log(Info, "Preloaded %i of %i textures, %i of them baked, on %i threads", (int)pending.size(), count, baked, jobs->workers() + 1);
+}
+
+void setTextureBaking(bool bake) {
+	baking = bake;
+}
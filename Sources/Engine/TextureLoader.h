@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Graphics.h"
+
+class JobSystem;
+
+// Textures are shared by file name, asking for the same file again returns the
+// same texture. Baked files are preferred over pngs, see BakedTexture.h.
+// Main thread only.
+Kore::Texture* loadTexture(const char* filename, bool readable = false);
+
+// Decodes every file that is not loaded yet at the same time on the jobs, then
+// uploads them all on the calling thread. Names may repeat, each file is read once.
+// Preloaded textures are readable.
+void preloadTextures(const char** filenames, int count, JobSystem* jobs);
+
+// From now on every png that has to be decoded is baked as well
+void setTextureBaking(bool bake);
@@ -2,10 +2,11 @@
 
 #include "TriggerCollider.h"
 #include "Collision.h"
+#include "TextureLoader.h"
 
 TriggerCollider::TriggerCollider(const char* meshFile, const char* textureFile, const Kore::VertexStructure& structure, mat4 M, float scale) {
     mesh = loadObj(meshFile);
-    image = new Kore::Texture(textureFile, true);
+    image = loadTexture(textureFile, true);
     
     // Mesh Vertex Buffer
     vertexBuffer = new Kore::VertexBuffer(mesh->numVertices, structure, 0);
@@ -4,7 +4,7 @@
 #include <Kore/Math/Core.h>
 #include <Kore/System.h>
 #include <Kore/Graphics/Image.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Graphics.h"
 
 #include "PhysicsObject.h"
 
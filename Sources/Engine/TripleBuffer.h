@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+// Hands complete copies of some state from one writing thread to one reading thread
+// without locks. The writer fills back() and publish() trades it for the spare slot,
+// acquire() trades the reader's front() for the spare slot if it holds something
+// newer. Neither side ever waits, the reader just sees the latest published state.
+template<class T> class TripleBuffer {
+public:
+	TripleBuffer() : backIndex(0), frontIndex(1), spare(2) {}
+
+	// Writer only
+	T& back() {
+		return slots[backIndex];
+	}
+
+	void publish() {
+		backIndex = spare.exchange(backIndex | fresh, std::memory_order_acq_rel) & ~fresh;
+	}
+
+	// Reader only, false when nothing was published since the last acquire
+	bool acquire() {
+		if ((spare.load(std::memory_order_relaxed) & fresh) == 0) return false;
+		frontIndex = spare.exchange(frontIndex, std::memory_order_acq_rel) & ~fresh;
+		return true;
+	}
+
+	const T& front() const {
+		return slots[frontIndex];
+	}
+
+private:
+	// Set in spare when the writer put a slot there that the reader did not take yet
+	static const int fresh = 4;
+
+	T slots[3];
+	int backIndex;
+	int frontIndex;
+	std::atomic<int> spare;
+};
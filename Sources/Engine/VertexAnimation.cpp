@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "VertexAnimation.h"
+#include "CommandBuffer.h"
+
+#include <Kore/Math/Core.h>
+#include <limits>
+
+#include "Rendering.h"
+
+using namespace Kore;
+
+namespace {
+	const int maxWidth = 1024;
+}
+
+VertexAnimation::VertexAnimation(Mesh** meshes, int meshCount, int frames, std::function<mat4(int mesh, float phase)> pose, Texture* image) : frames(frames), image(image) {
+	int vertexCount = 0;
+	int indexCount = 0;
+	for (int m = 0; m < meshCount; ++m) {
+		vertexCount += meshes[m]->numVertices;
+		indexCount += meshes[m]->numFaces * 3;
+	}
+
+	vec3* positions = new vec3[vertexCount * frames];
+	vec3* normals = new vec3[vertexCount * frames];
+	vec3 min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	vec3 max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+	for (int f = 0; f < frames; ++f) {
+		int v = 0;
+		for (int m = 0; m < meshCount; ++m) {
+			mat4 M = pose(m, (f + 0.5f) / frames);
+			for (int i = 0; i < meshes[m]->numVertices; ++i, ++v) {
+				float* vertex = &meshes[m]->vertices[i * 8];
+				vec4 p = M * vec4(vertex[0], vertex[1], vertex[2], 1);
+				vec4 n = M * vec4(vertex[5], vertex[6], vertex[7], 0);
+				vec3 position(p.x(), p.y(), p.z());
+				vec3 normal(n.x(), n.y(), n.z());
+				if (normal.getLength() > 0) normal = normal.normalize();
+				positions[f * vertexCount + v] = position;
+				normals[f * vertexCount + v] = normal;
+				for (int c = 0; c < 3; ++c) {
+					min[c] = Kore::min(min[c], position[c]);
+					max[c] = Kore::max(max[c], position[c]);
+				}
+			}
+		}
+	}
+	boundsMin = min;
+	boundsSize = max - min;
+	for (int c = 0; c < 3; ++c) {
+		if (boundsSize[c] <= 0) boundsSize[c] = 1;
+	}
+
+	// Positions are stored normalized to the animation's bounds
+	int width = Kore::min(vertexCount, maxWidth);
+	rows = (vertexCount + width - 1) / width;
+	animation = new Texture(width, rows * frames * 2, Image::RGBA32, false);
+	int* texels = (int*)animation->lock();
+	for (int f = 0; f < frames; ++f) {
+		for (int v = 0; v < vertexCount; ++v) {
+			vec3 p = positions[f * vertexCount + v] - boundsMin;
+			vec3 n = normals[f * vertexCount + v];
+			int x = v % width;
+			int y = f * rows + v / width;
+			texels[y * animation->texWidth + x] = packColor(p.x() / boundsSize.x(), p.y() / boundsSize.y(), p.z() / boundsSize.z(), 1);
+			texels[(frames * rows + y) * animation->texWidth + x] = packColor(n.x() * 0.5f + 0.5f, n.y() * 0.5f + 0.5f, n.z() * 0.5f + 0.5f, 1);
+		}
+	}
+	animation->unlock();
+	delete[] positions;
+	delete[] normals;
+
+	vertexBuffer = new VertexBuffer(vertexCount, *structure(), 0);
+	float* vertices = vertexBuffer->lock();
+	indexBuffer = new IndexBuffer(indexCount);
+	int* indices = indexBuffer->lock();
+	int v = 0;
+	int index = 0;
+	for (int m = 0; m < meshCount; ++m) {
+		for (int i = 0; i < meshes[m]->numFaces * 3; ++i) {
+			indices[index++] = v + meshes[m]->indices[i];
+		}
+		for (int i = 0; i < meshes[m]->numVertices; ++i, ++v) {
+			vertices[v * 4 + 0] = (v % width + 0.5f) / animation->texWidth;
+			vertices[v * 4 + 1] = (float)(v / width);
+			vertices[v * 4 + 2] = meshes[m]->vertices[i * 8 + 3];
+			vertices[v * 4 + 3] = 1.0f - meshes[m]->vertices[i * 8 + 4];
+		}
+	}
+	indexBuffer->unlock();
+	vertexBuffer->unlock();
+}
+
+VertexStructure* VertexAnimation::structure() {
+	static VertexStructure* structure = nullptr;
+	if (structure == nullptr) {
+		structure = new VertexStructure();
+		// texture column and row inside a frame
+		structure->add("vid", Float2VertexData);
+		structure->add("tex", Float2VertexData);
+	}
+	return structure;
+}
+
+void VertexAnimation::setLocations(Program* program) {
+	animationUnit = program->getTextureUnit("animation");
+	boundsMinLocation = program->getConstantLocation("boundsMin");
+	boundsSizeLocation = program->getConstantLocation("boundsSize");
+	framesLocation = program->getConstantLocation("frames");
+	rowsLocation = program->getConstantLocation("rows");
+	texelHeightLocation = program->getConstantLocation("texelHeight");
+}
+
+void VertexAnimation::render(CommandBuffer& commands, TextureUnit tex, VertexBuffer* instances, int count) {
+	commands.setTexture(tex, image);
+	commands.setTexture(animationUnit, animation);
+	commands.setTextureMinificationFilter(animationUnit, PointFilter);
+	commands.setTextureMagnificationFilter(animationUnit, PointFilter);
+	commands.setFloat3(boundsMinLocation, boundsMin.x(), boundsMin.y(), boundsMin.z());
+	commands.setFloat3(boundsSizeLocation, boundsSize.x(), boundsSize.y(), boundsSize.z());
+	commands.setFloat(framesLocation, (float)frames);
+	commands.setFloat(rowsLocation, (float)rows);
+	commands.setFloat(texelHeightLocation, 1.0f / animation->texHeight);
+
+	VertexBuffer* vertexBuffers[2];
+	vertexBuffers[0] = vertexBuffer;
+	vertexBuffers[1] = instances;
+	commands.setVertexBuffers(vertexBuffers, 2);
+	commands.setIndexBuffer(indexBuffer);
+	commands.drawIndexedVerticesInstanced(count);
+}
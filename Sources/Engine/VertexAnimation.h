@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+
+#include "Graphics.h"
+
+#include "ObjLoader.h"
+
+class CommandBuffer;
+
+// Several rigidly animated meshes merged into one, with a looping animation baked
+// into a texture: the vertex positions of every frame, followed by the normals of
+// every frame. The vertex shader looks up the frame of each instance's phase,
+// so the whole animated object is a single instanced draw.
+class VertexAnimation {
+public:
+	// pose returns the transform of a mesh at a phase in [0, 1)
+	VertexAnimation(Mesh** meshes, int meshCount, int frames, std::function<Kore::mat4(int mesh, float phase)> pose, Kore::Texture* image);
+
+	static Kore::VertexStructure* structure();
+
+	// Uniform locations of a program linked against structure()
+	void setLocations(Kore::Program* program);
+	void render(CommandBuffer& commands, Kore::TextureUnit tex, Kore::VertexBuffer* instances, int count);
+
+	int frames;
+	// Texture rows per frame, long meshes are wrapped
+	int rows;
+	Kore::vec3 boundsMin;
+	Kore::vec3 boundsSize;
+	Kore::Texture* image;
+	Kore::Texture* animation;
+
+private:
+	Kore::VertexBuffer* vertexBuffer;
+	Kore::IndexBuffer* indexBuffer;
+	Kore::TextureUnit animationUnit;
+	Kore::ConstantLocation boundsMinLocation;
+	Kore::ConstantLocation boundsSizeLocation;
+	Kore::ConstantLocation framesLocation;
+	Kore::ConstantLocation rowsLocation;
+	Kore::ConstantLocation texelHeightLocation;
+};
@@ -1,4 +1,7 @@
 #include "KitchenObject.h"
+#include "Engine/Frustum.h"
+#include "Engine/OcclusionBuffer.h"
+#include "Engine/RenderQueue.h"
 #include <Kore/Math/Quaternion.h>
 
 namespace {
@@ -11,9 +14,33 @@ namespace {
 			}
 		}
 	}
+
+	// The world space colliders where there are any, the transformed vertex bounds otherwise
+	void worldBounds(MeshObject* mesh, mat4 M, vec3& min, vec3& max) {
+		bool found = false;
+		for (int k = 0; k < mesh->colliderCount; ++k) {
+			BoxCollider* collider = mesh->collider[k];
+			if (collider == nullptr) continue;
+			vec3 cmin(collider->min.x(), collider->min.y(), collider->min.z());
+			vec3 cmax(collider->max.x(), collider->max.y(), collider->max.z());
+			for (int c = 0; c < 3; ++c) {
+				min[c] = found ? Kore::min(min[c], cmin[c]) : cmin[c];
+				max[c] = found ? Kore::max(max[c], cmax[c]) : cmax[c];
+			}
+			found = true;
+		}
+		if (found) return;
+		for (int corner = 0; corner < 8; ++corner) {
+			vec4 p = M * vec4(corner & 1 ? mesh->boundsMax.x() : mesh->boundsMin.x(), corner & 2 ? mesh->boundsMax.y() : mesh->boundsMin.y(), corner & 4 ? mesh->boundsMax.z() : mesh->boundsMin.z(), 1);
+			for (int c = 0; c < 3; ++c) {
+				min[c] = corner == 0 ? p[c] : Kore::min(min[c], p[c]);
+				max[c] = corner == 0 ? p[c] : Kore::max(max[c], p[c]);
+			}
+		}
+	}
 }
 
-KitchenObject::KitchenObject(MeshObject* body, MeshObject* door_closed, MeshObject* door_open, vec3 position, vec3 rotation, bool pizza) : body(body), door_closed(door_closed), door_open(door_open), pizza(pizza), readOnlyPos(position), visible(true), closed(true) {
+KitchenObject::KitchenObject(MeshObject* body, MeshObject* door_closed, MeshObject* door_open, vec3 position, vec3 rotation, bool pizza) : body(body), door_closed(door_closed), door_open(door_open), pizza(pizza), readOnlyPos(position), visible(true), batched(false), closed(true) {
 	M = mat4::Translation(position.x(), position.y(), position.z());
     M *= mat4::Rotation(rotation.x(), rotation.y(), rotation.z());
 
@@ -26,18 +53,76 @@ KitchenObject::KitchenObject(MeshObject* body, MeshObject* door_closed, MeshObje
 void KitchenObject::render(TextureUnit tex, ConstantLocation mLocation) {
 	if (!visible) return;
 
+    MeshObject* door = closed ? door_closed : door_open;
+    if (batched && door == nullptr) return;
+
     Kore::Graphics::setMatrix(mLocation, M);
-    if (body != nullptr) {
+    if (body != nullptr && !batched) {
         body->render(tex, mLocation);
     }
     
-    if (closed && door_closed != nullptr) {
-        door_closed->render(tex, mLocation);
-    } else if (!closed && door_open != nullptr) {
-        door_open->render(tex, mLocation);
+    if (door != nullptr) {
+        door->render(tex, mLocation);
     }
 }
 
+KitchenObject::State KitchenObject::state() const {
+	State state;
+	state.visible = visible;
+	state.closed = closed;
+	state.M = M;
+	state.position = readOnlyPos;
+	MeshObject* door = closed ? door_closed : door_open;
+	MeshObject* parts[2] = { batched ? nullptr : body, door };
+	for (int i = 0; i < 2; ++i) {
+		if (parts[i] != nullptr) worldBounds(parts[i], M, state.boundsMin[i], state.boundsMax[i]);
+	}
+	return state;
+}
+
+void KitchenObject::buildLods() {
+	MeshObject* parts[3] = { batched ? nullptr : body, door_closed, door_open };
+	for (int i = 0; i < 3; ++i) {
+		if (parts[i] != nullptr) parts[i]->buildLods();
+	}
+}
+
+int KitchenObject::enqueue(RenderQueue* queue, Program* program, TextureUnit tex, ConstantLocation mLocation, const Frustum& frustum, const OcclusionBuffer* occlusion, const State& state) const {
+	if (!state.visible) return 0;
+
+	int culled = 0;
+	MeshObject* door = state.closed ? door_closed : door_open;
+	MeshObject* parts[2] = { batched ? nullptr : body, door };
+	for (int i = 0; i < 2; ++i) {
+		MeshObject* part = parts[i];
+		if (part == nullptr) continue;
+		if (!frustum.isVisible(state.boundsMin[i], state.boundsMax[i]) || (occlusion != nullptr && !occlusion->isVisible(state.boundsMin[i], state.boundsMax[i]))) {
+			++culled;
+			continue;
+		}
+		mat4 M = state.M;
+		float distance = (state.position - queue->cameraPosition).getLength();
+		queue->add(RenderQueue::Opaque, program, part->image, part, state.position, [part, M, tex, mLocation, distance](CommandBuffer& commands) {
+			commands.setMatrix(mLocation, M);
+			part->render(commands, tex, distance);
+		});
+	}
+	return culled;
+}
+
+void KitchenObject::place(vec3 position, vec3 rotation) {
+	mat4 M = mat4::Translation(position.x(), position.y(), position.z());
+	M *= mat4::Rotation(rotation.x(), rotation.y(), rotation.z());
+
+	// The colliders are axis aligned boxes in world space, undo the old transformation first
+	mat4 change = M * this->M.Invert();
+	setM(body, change);
+	setM(door_closed, change);
+
+	this->M = M;
+	readOnlyPos = position;
+}
+
 void KitchenObject::openOrClose(float time) {
     float deltaT = time - lastTime;
     if (deltaT < 3) { // you can open the door only every x seconds
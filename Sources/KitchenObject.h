@@ -4,6 +4,10 @@
 #include "Engine/MeshObject.h"
 #include "Engine/TriggerCollider.h"
 
+class Frustum;
+class OcclusionBuffer;
+class RenderQueue;
+
 using namespace Kore;
 
 class KitchenObject {
@@ -11,10 +15,28 @@ class KitchenObject {
 public:
     KitchenObject(MeshObject* body, MeshObject* door_closed, MeshObject* door_open, vec3 position, vec3 rotation, bool pizza = false);
 
+	// What drawing needs, copied out so the object can be drawn while the simulation changes it
+	struct State {
+		bool visible;
+		bool closed;
+		mat4 M;
+		vec3 position;
+		// World bounds of the body and of the door that is shown
+		vec3 boundsMin[2];
+		vec3 boundsMax[2];
+	};
+	State state() const;
+
 	bool visible;
 	bool pizza;
 	Kore::vec3 readOnlyPos;
     void render(TextureUnit tex, ConstantLocation mLocation);
+    // Levels of detail for the parts enqueue() draws, call once batched is set
+    void buildLods();
+    // Returns how many of the parts were outside of the frustum or behind the occluders, occlusion can be nullptr
+    int enqueue(RenderQueue* queue, Program* program, TextureUnit tex, ConstantLocation mLocation, const Frustum& frustum, const OcclusionBuffer* occlusion, const State& state) const;
+    // Moves the object and its colliders, for rotations by multiples of pi/2
+    void place(vec3 position, vec3 rotation);
     void openOrClose(float time);
     void setTriggerCollider(TriggerCollider* triggerCollider);
     
@@ -22,6 +44,8 @@ public:
     MeshObject* door_closed;
     MeshObject* door_open;
     
+    // The body is part of a StaticBatch and not drawn here
+    bool batched;
     bool closed;
     float lastTime;
     mat4 M;
@@ -6,19 +6,113 @@
 #include <Kore/Math/Vector.h>
 #include <Kore/Math/Random.h>
 
+#include "Engine/Frustum.h"
 #include "Engine/Rendering.h"
 #include "Engine/InstancedMeshObject.h"
+#include "Engine/TextureLoader.h"
 
 using namespace Kore;
 
-Kore::VertexBuffer** landscapeVertices;
 Kore::IndexBuffer* landscapeIndices;
 Kore::Texture* landscapeTexture;
+int landscapeTilesDrawn = 0;
+int landscapeTriangles = 0;
 
 namespace {
 	int stoneCount;
 	InstancedMeshObject* stoneMesh;
 	Kore::Image* normalmap;
+
+	// The terrain is cut into tiles of tileQuads * tileQuads quads. Level of detail l
+	// only uses every 2^l-th vertex, skirts hanging down from the tile edges hide the
+	// cracks between neighbouring tiles drawn at different levels.
+	const int tileQuads = 32;
+	const int tileRow = tileQuads + 1;
+	const int lodCount = 4;
+	// In world units, larger maps get more tiles instead of larger ones
+	const float tileSize = 75.0f;
+	const float skirtDepth = 2.0f;
+	// Level l is used up to lodDistance * 2^l away from the camera
+	const float lodDistance = 60.0f;
+
+	struct Tile {
+		// Grid and skirt vertices, the instance buffer is shared
+		VertexBuffer* vertices[2];
+		vec3 min;
+		vec3 max;
+	};
+
+	std::vector<Tile> tiles;
+	VertexBuffer* identityInstance;
+	// Into landscapeIndices, which holds the index sets of all levels one after another
+	int lodStart[lodCount];
+	int lodIndexCount[lodCount];
+
+	// The tile's grid vertex k along an edge, 0 and 1 are the rows at y = 0 and y = tileQuads,
+	// 2 and 3 the columns at x = 0 and x = tileQuads
+	int edgeVertex(int edge, int k) {
+		switch (edge) {
+		case 0:
+			return k;
+		case 1:
+			return tileQuads * tileRow + k;
+		case 2:
+			return k * tileRow;
+		default:
+			return k * tileRow + tileQuads;
+		}
+	}
+
+	// Skirt vertices follow the grid, one row of them per edge
+	int skirtVertex(int edge, int k) {
+		return tileRow * tileRow + edge * tileRow + k;
+	}
+
+	void createIndices() {
+		int indexCount = 0;
+		for (int l = 0; l < lodCount; ++l) {
+			int quads = tileQuads >> l;
+			lodStart[l] = indexCount;
+			lodIndexCount[l] = quads * quads * 6 + 4 * quads * 6;
+			indexCount += lodIndexCount[l];
+		}
+
+		landscapeIndices = new IndexBuffer(indexCount);
+		int* indices = landscapeIndices->lock();
+		int i = 0;
+		for (int l = 0; l < lodCount; ++l) {
+			int step = 1 << l;
+			for (int y = 0; y < tileQuads; y += step) {
+				for (int x = 0; x < tileQuads; x += step) {
+					int baseindex = y * tileRow + x;
+					indices[i++] = baseindex;
+					indices[i++] = baseindex + step;
+					indices[i++] = baseindex + step * tileRow;
+
+					indices[i++] = baseindex + step;
+					indices[i++] = baseindex + step * tileRow + step;
+					indices[i++] = baseindex + step * tileRow;
+				}
+			}
+			for (int edge = 0; edge < 4; ++edge) {
+				for (int k = 0; k < tileQuads; k += step) {
+					indices[i++] = edgeVertex(edge, k);
+					indices[i++] = edgeVertex(edge, k + step);
+					indices[i++] = skirtVertex(edge, k);
+
+					indices[i++] = edgeVertex(edge, k + step);
+					indices[i++] = skirtVertex(edge, k + step);
+					indices[i++] = skirtVertex(edge, k);
+				}
+			}
+		}
+		landscapeIndices->unlock();
+	}
+
+	void copyVertex(const float* from, float* to, float drop) {
+		for (int c = 0; c < 8; ++c) to[c] = from[c];
+		to[1] -= drop;
+	}
 }
 
 vec3 getLandscapeNormal(float x, float y) {
@@ -36,14 +130,14 @@ vec3 getLandscapeNormal(float x, float y) {
 void createLandscape(VertexStructure** structures, float size, InstancedMeshObject* sMesh, int sCount, Ground*& ground) {
 	Kore::Image* map = new Kore::Image("Data/Textures/map.png", true);
 	normalmap = new Kore::Image("Data/Textures/mapnormals.png", true);
-	landscapeTexture = new Texture("Data/Textures/sand.png", true);
+	landscapeTexture = loadTexture("Data/Textures/sand.png", true);
 
-	const int w = 250;
-	const int h = 250;
+	const int tilesPerSide = Kore::max(1, (int)Kore::ceil(size / tileSize));
+	const int w = tilesPerSide * tileQuads;
+	const int h = tilesPerSide * tileQuads;
 	
-	landscapeVertices = new VertexBuffer*[2];
-	landscapeVertices[0] = new VertexBuffer((w + 1) * (h + 1), *structures[0], 0);
-	float* vertices = landscapeVertices[0]->lock();
+	// The whole grid first, the tiles copy their parts of it
+	float* vertices = new float[(w + 1) * (h + 1) * 8];
 	int i = 0;
 	
 	float* height = new float[(w+1)*(h+1)];
@@ -78,6 +172,8 @@ void createLandscape(VertexStructure** structures, float size, InstancedMeshObje
 
 	stoneCount = sCount;
 	stoneMesh = sMesh;
+	// Placed once, so no ring
+	stoneMesh->vertexBuffers[1] = new VertexBuffer(stoneCount, *structures[1], 1);
 	float* data = stoneMesh->vertexBuffers[1]->lock();
     for (int i = 0; i < stoneCount; i++) {
 		int xr = Random::get(0, w);
@@ -89,39 +185,72 @@ void createLandscape(VertexStructure** structures, float size, InstancedMeshObje
 	}
 	stoneMesh->vertexBuffers[1]->unlock();
 
-	landscapeVertices[0]->unlock();
-	
-	landscapeVertices[1] = new VertexBuffer(1, *structures[1], 1);
-	landscapeIndices = new IndexBuffer(w * h * 6);
-	int* indices = landscapeIndices->lock();
-	i = 0;
-	for (int y = 0; y < h; ++y) {
-		for (int x = 0; x < w; ++x) {
-			int baseindex = y * (w + 1) + x;
-			indices[i++] = baseindex;
-			indices[i++] = baseindex + 1;
-			indices[i++] = baseindex + (w + 1);
-
-			indices[i++] = baseindex + 1;
-			indices[i++] = baseindex + (w + 1);
-			indices[i++] = baseindex + (w + 1) + 1;
+	identityInstance = new VertexBuffer(1, *structures[1], 1);
+	data = identityInstance->lock();
+	setMatrix(data, 0, 0, 36, mat4::Identity());
+	setMatrix(data, 0, 16, 36, mat4::Identity());
+	setVec4(data, 0, 32, 36, vec4(1, 1, 1, 1));
+	identityInstance->unlock();
+
+	for (int ty = 0; ty < tilesPerSide; ++ty) {
+		for (int tx = 0; tx < tilesPerSide; ++tx) {
+			Tile tile;
+			tile.vertices[0] = new VertexBuffer(tileRow * tileRow + 4 * tileRow, *structures[0], 0);
+			tile.vertices[1] = identityInstance;
+			float* tileVertices = tile.vertices[0]->lock();
+			for (int y = 0; y <= tileQuads; ++y) {
+				for (int x = 0; x <= tileQuads; ++x) {
+					const float* vertex = &vertices[((ty * tileQuads + y) * (w + 1) + tx * tileQuads + x) * 8];
+					copyVertex(vertex, &tileVertices[(y * tileRow + x) * 8], 0.0f);
+					for (int c = 0; c < 3; ++c) {
+						tile.min[c] = x + y == 0 ? vertex[c] : Kore::min(tile.min[c], vertex[c]);
+						tile.max[c] = x + y == 0 ? vertex[c] : Kore::max(tile.max[c], vertex[c]);
+					}
+				}
+			}
+			for (int edge = 0; edge < 4; ++edge) {
+				for (int k = 0; k <= tileQuads; ++k) {
+					copyVertex(&tileVertices[edgeVertex(edge, k) * 8], &tileVertices[skirtVertex(edge, k) * 8], skirtDepth);
+				}
+			}
+			tile.min.y() -= skirtDepth;
+			tile.vertices[0]->unlock();
+			tiles.push_back(tile);
 		}
 	}
-	landscapeIndices->unlock();
+
+	delete[] vertices;
+	createIndices();
 }
 
-void renderLandscape(Kore::TextureUnit tex) {
+void renderLandscape(Kore::TextureUnit tex, mat4 view, mat4 projection) {
 	Graphics::setTexture(tex, landscapeTexture);
-
-	float* data = landscapeVertices[1]->lock();
-	setMatrix(data, 0, 0, 36, mat4::Identity());
-	setMatrix(data, 0, 16, 36, mat4::Identity());
-	setVec4(data, 0, 32, 36, vec4(1, 1, 1, 1));
-	landscapeVertices[1]->unlock();
-	
-	Graphics::setVertexBuffers(landscapeVertices, 2);
 	Graphics::setIndexBuffer(*landscapeIndices);
-	Graphics::drawIndexedVerticesInstanced(1);
+
+	vec4 eye = view.Invert() * vec4(0, 0, 0, 1);
+	vec3 cameraPosition(eye.x(), eye.y(), eye.z());
+	Frustum frustum(projection * view);
+
+	landscapeTilesDrawn = 0;
+	landscapeTriangles = 0;
+	for (unsigned t = 0; t < tiles.size(); ++t) {
+		Tile& tile = tiles[t];
+		if (!frustum.isVisible(tile.min, tile.max)) continue;
+
+		// Distance to the nearest point of the tile
+		vec3 nearest;
+		for (int c = 0; c < 3; ++c) {
+			nearest[c] = Kore::max(tile.min[c], Kore::min(tile.max[c], cameraPosition[c]));
+		}
+		float distance = Kore::sqrt((nearest - cameraPosition).squareLength());
+		int lod = 0;
+		while (lod < lodCount - 1 && distance > lodDistance * (1 << lod)) ++lod;
+
+		Graphics::setVertexBuffers(tile.vertices, 2);
+		Graphics::drawIndexedVerticesInstanced(1, lodStart[lod], lodIndexCount[lod]);
+		++landscapeTilesDrawn;
+		landscapeTriangles += lodIndexCount[lod] / 3;
+	}
 	
 	stoneMesh->render(tex, stoneCount);
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <Kore/Graphics/Graphics.h>
+#include "Engine/Graphics.h"
 #include "Ground.h"
 
 #include "Engine/InstancedMeshObject.h"
@@ -9,10 +9,14 @@ const int MAP_SIZE_INNER = 200;
 const int MAP_SIZE_OUTER = 300;
 const int STONE_COUNT = 64;
 
-extern Kore::VertexBuffer** landscapeVertices;
+// The index sets of all levels of detail, shared by the terrain tiles
 extern Kore::IndexBuffer* landscapeIndices;
 extern Kore::Texture* landscapeTexture;
+// Of the last renderLandscape()
+extern int landscapeTilesDrawn;
+extern int landscapeTriangles;
 
 void createLandscape(Kore::VertexStructure** structures, float size, InstancedMeshObject* sMesh, int sCount, Ground*&);
-void renderLandscape(Kore::TextureUnit tex);
+// Skips tiles outside of the frustum and picks the detail of the others by their distance
+void renderLandscape(Kore::TextureUnit tex, Kore::mat4 view, Kore::mat4 projection);
 vec3 getLandscapeNormal(float x, float y);
@@ -3,6 +3,11 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <Kore/IO/FileReader.h>
 #include <Kore/Math/Core.h>
@@ -12,15 +17,30 @@
 #include <Kore/Input/Mouse.h>
 #include <Kore/Audio/Mixer.h>
 #include <Kore/Graphics/Image.h>
-#include <Kore/Graphics/Graphics.h>
+#include "Engine/Graphics.h"
+#ifndef NULL_GRAPHICS
 #include <Kore/Graphics/Graphics2.h>
+#endif
 #include <Kore/Graphics/Color.h>
 #include <Kore/Log.h>
 
+#include "Engine/Benchmark.h"
 #include "Engine/Collision.h"
 #include "Engine/InstancedMeshObject.h"
+#include "Engine/InstanceBufferRing.h"
+#include "Engine/JobSystem.h"
+#include "Engine/Frustum.h"
+#include "Engine/RenderQueue.h"
+#include "Engine/SelfTest.h"
+#include "Engine/SpscQueue.h"
+#include "Engine/StaticBatch.h"
+#include "Engine/TextureAtlas.h"
+#include "Engine/TextureLoader.h"
 #include "Engine/TriggerCollider.h"
+#include "Engine/TripleBuffer.h"
 #include "Engine/ObjLoader.h"
+#include "Engine/OcclusionBuffer.h"
+#include "Engine/PackedVertices.h"
 #include "Engine/Particles.h"
 #include "Engine/PhysicsObject.h"
 #include "Engine/PhysicsWorld.h"
@@ -59,11 +79,15 @@ namespace {
     Shader* fragmentShader;
     Program* program;
 
+#ifndef NULL_GRAPHICS
 	Graphics2* g2;
+#endif
     
     Shader* instancedVertexShader;
     Shader* instancedFragmentShader;
     Program* instancedProgram;
+	// shader2 with the model matrix per instance, for repeated kitchen meshes
+	Program* staticInstancedProgram;
 
 	bool left_A;
 	bool left_C;
@@ -75,15 +99,33 @@ namespace {
     bool down_C;
 	bool jump;
 	bool crouch;
+	bool showStats = false;
     
+#ifndef NULL_GRAPHICS
     Kravur* font14;
     Kravur* font24;
     Kravur* font34;
     Kravur* font44;
+#endif
     
     mat4 P;
     mat4 View;
 	mat4 rooM;
+	// Furniture and room meshes that never move, the room is separate because it tiles its textures
+	StaticBatch* kitchenBatch;
+	RenderQueue* renderQueue;
+	JobSystem* jobs;
+	// Kitchen and room meshes outside of the frustum last frame
+	int kitchenCulled = 0;
+	// Batched kitchen and room meshes in the frustum but behind the occluders last frame
+	int kitchenOccluded = 0;
+	TextureAtlas* kitchenAtlas;
+	StaticBatch* roomBatch;
+	// The big furniture is rasterized into it every frame, what is hidden behind it is not
+	// submitted. O switches it off. The furniture never moves, so its M is read directly.
+	OcclusionBuffer* occlusion;
+	bool occlusionCulling = true;
+	const int occluders[] = { 0, 1, 7, 8, 10, 11, 12, 13, 14, 15, 16, 17, 18 };
     
     float horizontalAngle = -1.24f * pi;
     float verticalAngle = -0.5f;
@@ -94,6 +136,9 @@ namespace {
     ConstantLocation instancedPLocation;
     ConstantLocation instancedVLocation;
     TextureUnit instancedTex;
+	ConstantLocation staticInstancedPLocation;
+	ConstantLocation staticInstancedVLocation;
+	TextureUnit staticInstancedTex;
 	
 	PhysicsWorld physics;
     
@@ -103,6 +148,25 @@ namespace {
     ConstantLocation mLocation;
     ConstantLocation lightPosLocation;
 	VertexStructure structure;
+
+	// With --packed-vertices the kitchen meshes and ants keep 16 instead of 32 bytes per vertex
+	// and are drawn by the *_packed variants of the shaders. The static batches stay as they are.
+	bool packedVertices = false;
+	VertexStructure packedStructure;
+	Program* packedProgram;
+	TextureUnit packedTex;
+	ConstantLocation packedPLocation;
+	ConstantLocation packedVLocation;
+	ConstantLocation packedMLocation;
+	PackedLocations packedLocations;
+	Program* packedInstancedProgram;
+	TextureUnit packedInstancedTex;
+	ConstantLocation packedInstancedPLocation;
+	ConstantLocation packedInstancedVLocation;
+	PackedLocations packedInstancedLocations;
+	// What the kitchen meshes are created with, structure or packedStructure
+	VertexStructure* meshStructure;
+	const PackedLocations* meshPacking;
     
     //BoxCollider boxCollider(vec3(-46.0f, -4.0f, 44.0f), vec3(10.6f, 4.4f, 4.0f));
     
@@ -110,8 +174,43 @@ namespace {
     
     double lastTime;
     const int maxPizza = 6;
+	// Pizzas are kitchen objects from PIZZA_OFFSET on, the ones from pizzaCount on are hidden
 	int pizzaCount = 0;
 
+	// Everything drawing needs from one simulation tick
+	struct Snapshot {
+		vec3 cameraPos;
+		vec3 cameraDir;
+		vec3 cameraUp;
+		// Crosshair color, depending on what is hovered
+		unsigned crosshair;
+		int pizzasLeft;
+		int objectCount;
+		KitchenObject* objects[30];
+		KitchenObject::State objectStates[30];
+		AntState ants[Ant::maxAnts];
+	};
+	TripleBuffer<Snapshot> snapshots;
+
+	// Input callbacks only queue events, the simulation applies them
+	struct InputEvent {
+		enum Type { KeyPressed, KeyReleased, MouseLook, MouseButton, MouseWheel };
+		Type type;
+		// Key code, mouse button or wheel delta
+		int value;
+		float horizontal;
+		float vertical;
+	};
+	SpscQueue<InputEvent, 256> inputEvents;
+
+	// With --pipelined the simulation runs on its own thread, one tick ahead of drawing
+	bool pipelined = false;
+	std::thread simulationThread;
+	std::mutex tickMutex;
+	std::condition_variable tickWanted;
+	bool tickRequested = false;
+	bool stopTicks = false;
+
     ParticleRenderer* particleRenderer;
     
     MeshObject* fridgeBody;
@@ -231,21 +330,174 @@ namespace {
 		return result;
 	}
     
-    void update() {
+    void applyKeyDown(KeyCode code) {
+        if (code == Key_Up) {
+            up_A = true;
+        } else if (code == Key_Down) {
+            down_A = true;
+        } else if (code == Key_Left) {
+            right_A = true;
+        } else if (code == Key_Right) {
+            left_A = true;
+        } else if (code == Key_W) {
+			up_C = true;
+		} else if (code == Key_S) {
+			down_C = true;
+		} else if (code == Key_A) {
+			right_C = true;
+		} else if (code == Key_D) {
+			left_C = true;
+		} else if (code == Key_Control) {
+			crouch = true;
+		} else if (code == Key_Space) {
+			jump = true;
+		} else if (code == Key_R) {
+			for (int i = 0; i < pizzaCount; ++i) {
+				KitchenObject* pizza = kitchenObjects[PIZZA_OFFSET + i];
+				if (pizza == hovered) hovered = nullptr;
+
+				Ant::lessPizza(pizza->readOnlyPos);
+				pizza->visible = false;
+			}
+			pizzaCount = 0;
+		} else if (code == Key_L) {
+            Kore::log(Kore::Info, "Camera pos %f %f %f", cameraPos.x(), cameraPos.y(), cameraPos.z());
+            Kore::log(Kore::Info, "Camera angle horizontal %f", horizontalAngle);
+            Kore::log(Kore::Info, "Camera angle vertical %f", verticalAngle);
+        } else if (code == Key_T) {
+            int i = 0;
+            while (kitchenObjects[i] != nullptr) {
+                kitchenObjects[i]->openOrClose(lastTime);
+                ++i;
+            }
+        }
+    }
+    
+    void applyKeyUp(KeyCode code) {
+		if (code == Key_Up) {
+			up_A = false;
+		}
+		else if (code == Key_Down) {
+			down_A = false;
+		}
+		else if (code == Key_Left) {
+			right_A = false;
+		}
+		else if (code == Key_Right) {
+			left_A = false;
+		}
+		else if (code == Key_W) {
+			up_C = false;
+		}
+		else if (code == Key_S) {
+			down_C = false;
+		}
+		else if (code == Key_A) {
+			right_C = false;
+		}
+		else if (code == Key_D) {
+			left_C = false;
+		}
+		else if (code == Key_Control) {
+			crouch = false;
+		}
+		else if (code == Key_Space) {
+			jump = false;
+		}
+    }
+    
+    void applyMouseLook(float horizontal, float vertical) {
+        horizontalAngle += horizontal;
+        verticalAngle += vertical;
+		verticalAngle = Kore::min(Kore::max(verticalAngle, -0.49f * pi), 0.49f * pi);
+    }
+    
+    void applyMousePress(int button) {
+		if (button == 0) {
+			vec3 norm;
+			float dist = std::numeric_limits<float>::infinity();
+			hovered = getIntersectingMesh(cameraPos, cameraDir, dist, norm);
+
+			if (hovered != nullptr && hovered->pizza) {
+				for (int i = 0; i < pizzaCount; ++i) {
+					if (kitchenObjects[PIZZA_OFFSET + i] == hovered) {
+						Ant::lessPizza(hovered->readOnlyPos);
+						hovered->visible = false;
+						// hidden pizzas stay behind the shown ones
+						kitchenObjects[PIZZA_OFFSET + i] = kitchenObjects[PIZZA_OFFSET + pizzaCount - 1];
+						kitchenObjects[PIZZA_OFFSET + pizzaCount - 1] = hovered;
+						hovered = nullptr;
+
+						--pizzaCount;
+						break;
+					}
+				}
+			}
+			else if (dist < std::numeric_limits<float>::infinity() && pizzaCount < maxPizza) {
+				vec3 pos = cameraPos + cameraDir * dist;
+				vec3 rot(0.0f, 0.0f, 0.0f);
+				if (norm.y() < -0.9f) rot.y() = pi;
+				if (norm.x() > 0.9f) rot.y() = -0.5f * pi;
+				if (norm.x() < -0.9f) rot.y() = 0.5f * pi;
+				if (norm.z() > 0.9f) rot.z() = 0.5f * pi;
+				if (norm.z() < -0.9f) rot.z() = -0.5f * pi;
+
+				KitchenObject* pizza = kitchenObjects[PIZZA_OFFSET + pizzaCount];
+				pizza->place(pos, rot);
+				pizza->visible = true;
+				Ant::morePizze(pos);
+
+				++pizzaCount;
+			}
+		}
+		else if (button == 1) {
+			if (hovered != nullptr) {
+				hovered->openOrClose(lastTime);
+			}
+        }
+    }
+    
+    void apply(const InputEvent& event) {
+        switch (event.type) {
+        case InputEvent::KeyPressed:
+            applyKeyDown((KeyCode)event.value);
+            break;
+        case InputEvent::KeyReleased:
+            applyKeyUp((KeyCode)event.value);
+            break;
+        case InputEvent::MouseLook:
+            applyMouseLook(event.horizontal, event.vertical);
+            break;
+        case InputEvent::MouseButton:
+            applyMousePress(event.value);
+            break;
+        case InputEvent::MouseWheel:
+            cameraPos -= cameraDir * (CAMERA_ZOOM_SPEED * event.value);
+            break;
+        }
+    }
+    
+    void queueInput(InputEvent::Type type, int value, float horizontal = 0, float vertical = 0) {
+        InputEvent event;
+        event.type = type;
+        event.value = value;
+        event.horizontal = horizontal;
+        event.vertical = vertical;
+        if (!inputEvents.push(event)) {
+            log(Warning, "Input queue full, event dropped");
+        }
+    }
+    
+    void simulate() {
         double t = System::time() - startTime;
         double deltaT = t - lastTime;
         
         lastTime = t;
-        Kore::Audio::update();
         
-        Graphics::begin();
-        Graphics::clear(Graphics::ClearColorFlag | Graphics::ClearDepthFlag | Graphics::ClearStencilFlag, 0xFF0000FF, 1.0f, 0);
-        
-        // Important: We need to set the program before we set a uniform
-        program->set();
-        Graphics::setBlendingMode(SourceAlpha, Kore::BlendingOperation::InverseSourceAlpha);
-        Graphics::setRenderState(BlendingState, true);
-        Graphics::setRenderState(DepthTest, true);
+        InputEvent event;
+        while (inputEvents.pop(event)) {
+            apply(event);
+        }
         
         // Direction: Spherical coordinates to Cartesian coordinates conversion
         cameraDir = vec3(
@@ -283,10 +535,80 @@ namespace {
 		vec3 norm;
 		hovered = getIntersectingMesh(cameraPos, cameraDir, distMin, norm);
         
-        View = mat4::lookAlong(cameraDir, cameraPos, cameraUp);
+        Ant::moveEverybody(deltaT);
         
-        Graphics::setMatrix(pLocation, P);
-        Graphics::setMatrix(vLocation, View);
+        Snapshot& snapshot = snapshots.back();
+        snapshot.cameraPos = cameraPos;
+        snapshot.cameraDir = cameraDir;
+        snapshot.cameraUp = cameraUp;
+		if (hovered == nullptr) {
+			snapshot.crosshair = Color::White;
+		}
+		else if (hovered->pizza) {
+			snapshot.crosshair = Color::Red;
+		}
+		else if (hovered->door_closed == nullptr) {
+			snapshot.crosshair = Color::Green;
+		}
+		else {
+			snapshot.crosshair = Color::Blue;
+		}
+        snapshot.pizzasLeft = maxPizza - pizzaCount;
+        snapshot.objectCount = 0;
+        while (kitchenObjects[snapshot.objectCount] != nullptr) {
+            snapshot.objects[snapshot.objectCount] = kitchenObjects[snapshot.objectCount];
+            snapshot.objectStates[snapshot.objectCount] = kitchenObjects[snapshot.objectCount]->state();
+            ++snapshot.objectCount;
+        }
+        Ant::capture(snapshot.ants);
+        snapshots.publish();
+    }
+    
+    void simulationLoop() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(tickMutex);
+                tickWanted.wait(lock, []() { return tickRequested || stopTicks; });
+                if (stopTicks) return;
+                tickRequested = false;
+            }
+            simulate();
+        }
+    }
+    
+    // The first tick is simulated right away so there is always something to draw
+    void startSimulation() {
+        simulate();
+        if (pipelined) {
+            simulationThread = std::thread(simulationLoop);
+        }
+    }
+    
+    void stopSimulation() {
+        if (!pipelined) return;
+        {
+            std::lock_guard<std::mutex> lock(tickMutex);
+            stopTicks = true;
+        }
+        tickWanted.notify_one();
+        simulationThread.join();
+    }
+    
+    void render(const Snapshot& snapshot) {
+#ifndef NULL_GRAPHICS
+        Kore::Audio::update();
+#endif
+        
+        Graphics::begin();
+        InstanceBufferRing::nextFrame();
+        Graphics::clear(Graphics::ClearColorFlag | Graphics::ClearDepthFlag | Graphics::ClearStencilFlag, 0xFF0000FF, 1.0f, 0);
+        
+        // Blending is switched on and off by the render queue
+        Graphics::setBlendingMode(SourceAlpha, Kore::BlendingOperation::InverseSourceAlpha);
+        Graphics::setRenderState(DepthTest, true);
+        
+        View = mat4::lookAlong(snapshot.cameraDir, snapshot.cameraPos, snapshot.cameraUp);
+        renderQueue->begin(snapshot.cameraPos);
         
         // update light pos
         /*lightPosX = 100;
@@ -300,38 +622,53 @@ namespace {
          tankTics->update(deltaT);
          }
          
-         renderLandscape(tex);
+         renderLandscape(tex, View, P);
          tankTics->render(tex, View, vLocation);*/
         
         // render the kitchen
-        int i = 0;
-        while (kitchenObjects[i] != nullptr) {
-            kitchenObjects[i]->render(tex, mLocation);
+        Frustum frustum(P * View);
+        const OcclusionBuffer* occlusionTest = nullptr;
+        if (occlusionCulling) {
+            occlusion->begin(P * View);
+            for (int i = 0; i < (int)(sizeof(occluders) / sizeof(occluders[0])); ++i) {
+                KitchenObject* occluder = kitchenObjects[occluders[i]];
+                Mesh* mesh = occluder->body->mesh;
+                occlusion->addOccluder(mesh->vertices, 8, mesh->indices, mesh->numFaces, occluder->M);
+            }
+            occlusionTest = occlusion;
+        }
+        kitchenBatch->enqueue(renderQueue, program, tex, mLocation, frustum, occlusionTest);
+        kitchenCulled = kitchenBatch->culled;
+        kitchenOccluded = kitchenBatch->occluded;
+        Program* meshProgram = packedVertices ? packedProgram : program;
+        TextureUnit meshTex = packedVertices ? packedTex : tex;
+        ConstantLocation meshMLocation = packedVertices ? packedMLocation : mLocation;
+        for (int i = 0; i < snapshot.objectCount; ++i) {
+            kitchenCulled += snapshot.objects[i]->enqueue(renderQueue, meshProgram, meshTex, meshMLocation, frustum, occlusionTest, snapshot.objectStates[i]);
             
             // test: render trigger collider
             /*if (kitchenObjects[i]->triggerCollider != nullptr) {
                 kitchenObjects[i]->triggerCollider->renderTest(tex, mLocation);
             }*/
-            ++i;
         }
         
-		Graphics::setTextureAddressing(tex, U, Repeat);
-		Graphics::setTextureAddressing(tex, V, Repeat);
-
         // render the room
-        Kore::Graphics::setMatrix(mLocation, rooM);
-
-		for (unsigned oi = 0; roomObjects[oi] != nullptr; ++oi) {
-			roomObjects[oi]->render(tex, mLocation);
-		}
+		roomBatch->enqueue(renderQueue, program, tex, mLocation, frustum, occlusionTest);
+		kitchenCulled += roomBatch->culled;
+		kitchenOccluded += roomBatch->occluded;
         
-        instancedProgram->set();
+        Ant::prepare(snapshot.ants, View, P, jobs, occlusionTest);
+        renderQueue->add(RenderQueue::Opaque, packedVertices ? packedInstancedProgram : instancedProgram, nullptr, nullptr, snapshot.cameraPos, [](CommandBuffer& commands) {
+            Ant::render(commands, packedVertices ? packedInstancedTex : instancedTex);
+        });
+        renderQueue->add(RenderQueue::Opaque, nullptr, nullptr, nullptr, snapshot.cameraPos, [](CommandBuffer& commands) {
+            Ant::renderWalking(commands, View, P);
+        });
+        renderQueue->add(RenderQueue::Transparent, nullptr, nullptr, nullptr, snapshot.cameraPos + snapshot.cameraDir * Ant::impostorDistance, [](CommandBuffer& commands) {
+            Ant::renderImpostors(commands, View, P);
+        });
         
-        Graphics::setMatrix(instancedPLocation, P);
-        Graphics::setMatrix(instancedVLocation, View);
-        
-        Ant::moveEverybody(deltaT);
-        Ant::render(instancedVLocation, instancedTex, View);
+        renderQueue->submit();
         
         
         /*
@@ -379,20 +716,10 @@ namespace {
          textRenderer->end();*/
 
         
+#ifndef NULL_GRAPHICS
 		g2->begin(false);
         
-		if (hovered == nullptr) {
-            g2->setColor(Color::White);
-        }
-		else if (hovered->pizza) {
-            g2->setColor(Color::Red);
-		}
-		else if (hovered->door_closed == nullptr) {
-			g2->setColor(Color::Green);
-		}
-		else {
-			g2->setColor(Color::Blue);
-		}
+		g2->setColor(snapshot.crosshair);
 		g2->drawRect(width / 2 -  1, height / 2 -  1, 2, 2, 1);
 		g2->drawRect(width / 2 +  8, height / 2 -  1, 8, 2, 1);
 		g2->drawRect(width / 2 - 16, height / 2 -  1, 8, 2, 1);
@@ -404,94 +731,60 @@ namespace {
         g2->setFontColor(Color::Black);
         g2->setFontSize(24);
         char pizza_text[42];
-        sprintf(pizza_text, "You have %i pizza", maxPizza-pizzaCount);
+        sprintf(pizza_text, "You have %i pizza", snapshot.pizzasLeft);
         g2->drawString(pizza_text, 10, 10);
+
+		if (showStats) {
+			char stats[256];
+			sprintf(stats, "Ants visible %i, culled %i, occluded %i, without legs %i, impostors %i, walk cycle %s, corpses %i (%i uploaded)", Ant::visibleAnts, Ant::culledAnts, Ant::occludedAnts, Ant::legsSkipped, Ant::impostors, Ant::vertexAnimation ? "baked" : "per leg", Ant::corpses, Ant::corpsesUploaded);
+			g2->drawString(stats, 10, 40);
+			sprintf(stats, "Draw items %i, program switches %i, kitchen meshes culled %i, batched ones occluded %i, occluder triangles %i", renderQueue->items, renderQueue->programSwitches, kitchenCulled, kitchenOccluded, occlusionCulling ? occlusion->occluderTriangles : 0);
+			g2->drawString(stats, 10, 70);
+			const CommandBuffer::Stats& frame = renderQueue->commands.stats;
+			sprintf(stats, "Draws %i, instances %i, triangles %i, bytes locked %i, texture switches %i, commands %i", frame.drawCalls, frame.instances, frame.triangles, frame.bytesLocked, frame.textureSwitches, frame.commands);
+			g2->drawString(stats, 10, 100);
+		}
+#endif
         
         Graphics::end();
 		Graphics::swapBuffers();
     }
     
+    void update() {
+        if (pipelined) {
+            // Draws tick N while the simulation thread works on N + 1. When the
+            // simulation fell behind, the last tick is drawn again.
+            snapshots.acquire();
+            {
+                std::lock_guard<std::mutex> lock(tickMutex);
+                tickRequested = true;
+            }
+            tickWanted.notify_one();
+        }
+        else {
+            simulate();
+            snapshots.acquire();
+        }
+        render(snapshots.front());
+    }
+    
     void keyDown(KeyCode code, wchar_t character) {
-        if (code == Key_Up) {
-            up_A = true;
-        } else if (code == Key_Down) {
-            down_A = true;
-        } else if (code == Key_Left) {
-            right_A = true;
-        } else if (code == Key_Right) {
-            left_A = true;
-        } else if (code == Key_W) {
-			up_C = true;
-		} else if (code == Key_S) {
-			down_C = true;
-		} else if (code == Key_A) {
-			right_C = true;
-		} else if (code == Key_D) {
-			left_C = true;
-		} else if (code == Key_Control) {
-			crouch = true;
-		} else if (code == Key_Space) {
-			jump = true;
-		} else if (code == Key_R) {
-			for (int i = 0; i < maxPizza; ++i) {
-				if (kitchenObjects[PIZZA_OFFSET + i] != nullptr) {
-					if (kitchenObjects[PIZZA_OFFSET + i] == hovered) hovered = nullptr;
-
-					Ant::lessPizza(kitchenObjects[PIZZA_OFFSET + i]->readOnlyPos);
-
-					delete kitchenObjects[PIZZA_OFFSET + i]->body;
-					delete kitchenObjects[PIZZA_OFFSET + i];
-
-					kitchenObjects[PIZZA_OFFSET + i] = nullptr;
-				}
-			}
-			pizzaCount = 0;
-		} else if (code == Key_Escape) {
+        // Keys that only change how things are drawn are handled right here
+        if (code == Key_Escape) {
             Kore::System::stop();
-        } else if (code == Key_L) {
-            Kore::log(Kore::Info, "Camera pos %f %f %f", cameraPos.x(), cameraPos.y(), cameraPos.z());
-            Kore::log(Kore::Info, "Camera angle horizontal %f", horizontalAngle);
-            Kore::log(Kore::Info, "Camera angle vertical %f", verticalAngle);
-        } else if (code == Key_T) {
-            int i = 0;
-            while (kitchenObjects[i] != nullptr) {
-                kitchenObjects[i]->openOrClose(lastTime);
-                ++i;
-            }
+        } else if (code == Key_I) {
+            showStats = !showStats;
+        } else if (code == Key_V) {
+            Ant::vertexAnimation = !Ant::vertexAnimation;
+        } else if (code == Key_O) {
+            occlusionCulling = !occlusionCulling;
+        } else {
+            queueInput(InputEvent::KeyPressed, code);
         }
     }
     
     void keyUp(KeyCode code, wchar_t character) {
-		if (code == Key_Up) {
-			up_A = false;
-		}
-		else if (code == Key_Down) {
-			down_A = false;
-		}
-		else if (code == Key_Left) {
-			right_A = false;
-		}
-		else if (code == Key_Right) {
-			left_A = false;
-		}
-		else if (code == Key_W) {
-			up_C = false;
-		}
-		else if (code == Key_S) {
-			down_C = false;
-		}
-		else if (code == Key_A) {
-			right_C = false;
-		}
-		else if (code == Key_D) {
-			left_C = false;
-		}
-		else if (code == Key_Control) {
-			crouch = false;
-		}
-		else if (code == Key_Space) {
-			jump = false;
-		}
+        queueInput(InputEvent::KeyReleased, code);
     }
     
 	double lastMouseTime = 0;
@@ -502,61 +795,30 @@ namespace {
 		lastMouseTime = t;
 		if (deltaT > 1.0f / 30.0f) return;
 
-        horizontalAngle += CAMERA_ROTATION_SPEED * movementX * deltaT * 7.0f;
-        verticalAngle -= CAMERA_ROTATION_SPEED * movementY * deltaT * 7.0f;
-		verticalAngle = Kore::min(Kore::max(verticalAngle, -0.49f * pi), 0.49f * pi);
+        queueInput(InputEvent::MouseLook, 0, CAMERA_ROTATION_SPEED * movementX * deltaT * 7.0f, -CAMERA_ROTATION_SPEED * movementY * deltaT * 7.0f);
     }
     
     void mousePress(int windowId, int button, int x, int y) {
-		if (button == 0) {
-			vec3 norm;
-			float dist = std::numeric_limits<float>::infinity();
-			hovered = getIntersectingMesh(cameraPos, cameraDir, dist, norm);
-
-			if (hovered != nullptr && hovered->pizza) {
-				for (int i = 0; i < pizzaCount; ++i) {
-					if (kitchenObjects[PIZZA_OFFSET + i] == hovered) {
-						Ant::lessPizza(kitchenObjects[PIZZA_OFFSET + i]->readOnlyPos);
-						kitchenObjects[PIZZA_OFFSET + i] = kitchenObjects[PIZZA_OFFSET + pizzaCount - 1];
-						kitchenObjects[PIZZA_OFFSET + pizzaCount - 1] = nullptr;
-
-						delete hovered->body;
-						delete hovered;
-						hovered = nullptr;
-
-						--pizzaCount;
-					}
-				}
-			}
-			else if (dist < std::numeric_limits<float>::infinity() && pizzaCount < maxPizza) {
-				vec3 pos = cameraPos + cameraDir * dist;
-				vec3 rot(0.0f, 0.0f, 0.0f);
-				if (norm.y() < -0.9f) rot.y() = pi;
-				if (norm.x() > 0.9f) rot.y() = -0.5f * pi;
-				if (norm.x() < -0.9f) rot.y() = 0.5f * pi;
-				if (norm.z() > 0.9f) rot.z() = 0.5f * pi;
-				if (norm.z() < -0.9f) rot.z() = -0.5f * pi;
-
-				MeshObject* pizza = new MeshObject("Data/Meshes/pizza.obj", "Data/Meshes/pizza_collider.obj", "Data/Textures/pizza.png", structure, 1.0f);
-				kitchenObjects[PIZZA_OFFSET + pizzaCount] = new KitchenObject(pizza, nullptr, nullptr, pos, rot, true);
-				Ant::morePizze(pos);
-
-				++pizzaCount;
-				kitchenObjects[PIZZA_OFFSET + pizzaCount] = nullptr;
-			}
-		}
-		else if (button == 1) {
-			if (hovered != nullptr) {
-				hovered->openOrClose(lastTime);
-			}
-        }
+        queueInput(InputEvent::MouseButton, button);
     }
     
     void mouseScroll(int windowId, int delta) {
-        cameraPos -= cameraDir * (CAMERA_ZOOM_SPEED * delta);
+        queueInput(InputEvent::MouseWheel, delta);
     }
     
     void init() {
+        jobs = new JobSystem;
+        
+        // Decoded together up front, the meshes below then find their textures loaded
+        const char* textures[] = {
+            "Data/Textures/marble_tile.png", "Data/Textures/omi_tapete.png", "Data/Textures/ceilingTexture.png",
+            "Data/Textures/fridgeAndCupboardTexture.png", "Data/Textures/CakeTexture.png", "Data/Textures/LightFurnitureTexture.png",
+            "Data/Textures/ovenTexture.png", "Data/Textures/stoveTexture_off.png", "Data/Textures/microwaveTexture.png",
+            "Data/Textures/white.png", "Data/Textures/black.png", "Data/Textures/creditsTexture.png",
+            "Data/Textures/lampTexture.png", "Data/Textures/pizza.png", "Data/Textures/tank_bottom.png"
+        };
+        preloadTextures(textures, sizeof(textures) / sizeof(textures[0]), jobs);
+        
         FileReader vs("shader.vert");
         FileReader fs("shader.frag");
         instancedVertexShader = new Shader(vs.readAll(), vs.size(), VertexShader);
@@ -587,7 +849,7 @@ namespace {
         /*stoneMesh = new InstancedMeshObject("Data/Meshes/stone.obj", "Data/Textures/stone.png", structures, STONE_COUNT);
          projectileMesh = new MeshObject("Data/Meshes/projectile.obj", "Data/Textures/projectile.png", structures, PROJECTILE_SIZE);
          
-         particleImage = new Texture("Data/Textures/particle.png", true);
+         particleImage = loadTexture("Data/Textures/particle.png", true);
          particleRenderer = new ParticleRenderer(structures);
          projectiles = new Projectiles(1000, 20, particleImage, projectileMesh, structures, &physics);*/
         
@@ -614,25 +876,68 @@ namespace {
         vLocation = program->getConstantLocation("V");
         mLocation = program->getConstantLocation("M");
 
+		FileReader vs2Instanced("shader2_instanced.vert");
+		staticInstancedProgram = new Program;
+		staticInstancedProgram->setVertexShader(new Shader(vs2Instanced.readAll(), vs2Instanced.size(), VertexShader));
+		staticInstancedProgram->setFragmentShader(fragmentShader);
+		staticInstancedProgram->link(structures, 2);
+		staticInstancedTex = staticInstancedProgram->getTextureUnit("tex");
+		staticInstancedPLocation = staticInstancedProgram->getConstantLocation("P");
+		staticInstancedVLocation = staticInstancedProgram->getConstantLocation("V");
+
+		meshStructure = &structure;
+		meshPacking = nullptr;
+		if (packedVertices) {
+			packedStructure = VertexStructure();
+			addPackedElements(packedStructure);
+
+			FileReader vs2Packed("shader2_packed.vert");
+			packedProgram = new Program;
+			packedProgram->setVertexShader(new Shader(vs2Packed.readAll(), vs2Packed.size(), VertexShader));
+			packedProgram->setFragmentShader(fragmentShader);
+			packedProgram->link(packedStructure);
+			packedTex = packedProgram->getTextureUnit("tex");
+			packedPLocation = packedProgram->getConstantLocation("P");
+			packedVLocation = packedProgram->getConstantLocation("V");
+			packedMLocation = packedProgram->getConstantLocation("M");
+			packedLocations = getPackedLocations(packedProgram);
+
+			VertexStructure** packedStructures = new VertexStructure*[2];
+			packedStructures[0] = &packedStructure;
+			packedStructures[1] = structures[1];
+			FileReader vsPacked("shader_packed.vert");
+			packedInstancedProgram = new Program;
+			packedInstancedProgram->setVertexShader(new Shader(vsPacked.readAll(), vsPacked.size(), VertexShader));
+			packedInstancedProgram->setFragmentShader(instancedFragmentShader);
+			packedInstancedProgram->link(packedStructures, 2);
+			packedInstancedTex = packedInstancedProgram->getTextureUnit("tex");
+			packedInstancedPLocation = packedInstancedProgram->getConstantLocation("P");
+			packedInstancedVLocation = packedInstancedProgram->getConstantLocation("V");
+			packedInstancedLocations = getPackedLocations(packedInstancedProgram);
+
+			meshStructure = &packedStructure;
+			meshPacking = &packedLocations;
+		}
+
 		rooM = mat4::Translation(0, -1.0f, 6.5f);
-        roomObjects[0] = new MeshObject("Data/Meshes/room_floor.obj", "Data/Meshes/room_floor_collider.obj", "Data/Textures/marble_tile.png", structure, 1.0f);
+        roomObjects[0] = new MeshObject("Data/Meshes/room_floor.obj", "Data/Meshes/room_floor_collider.obj", "Data/Textures/marble_tile.png", *meshStructure, 1.0f, meshPacking);
 		roomObjects[0]->collider[0]->trans(rooM);
-		roomObjects[1] = new MeshObject("Data/Meshes/room_wall1.obj", "Data/Meshes/room_wall1_collider.obj", "Data/Textures/omi_tapete.png", structure, 1.0f);
+		roomObjects[1] = new MeshObject("Data/Meshes/room_wall1.obj", "Data/Meshes/room_wall1_collider.obj", "Data/Textures/omi_tapete.png", *meshStructure, 1.0f, meshPacking);
 		roomObjects[1]->collider[0]->trans(rooM);
-		roomObjects[2] = new MeshObject("Data/Meshes/room_wall2.obj", "Data/Meshes/room_wall2_collider.obj", "Data/Textures/omi_tapete.png", structure, 1.0f);
+		roomObjects[2] = new MeshObject("Data/Meshes/room_wall2.obj", "Data/Meshes/room_wall2_collider.obj", "Data/Textures/omi_tapete.png", *meshStructure, 1.0f, meshPacking);
 		roomObjects[2]->collider[0]->trans(rooM);
-		roomObjects[3] = new MeshObject("Data/Meshes/room_wall3.obj", "Data/Meshes/room_wall3_collider.obj", "Data/Textures/omi_tapete.png", structure, 1.0f);
+		roomObjects[3] = new MeshObject("Data/Meshes/room_wall3.obj", "Data/Meshes/room_wall3_collider.obj", "Data/Textures/omi_tapete.png", *meshStructure, 1.0f, meshPacking);
 		roomObjects[3]->collider[0]->trans(rooM);
-		roomObjects[4] = new MeshObject("Data/Meshes/room_wall4.obj", "Data/Meshes/room_wall4_collider.obj", "Data/Textures/omi_tapete.png", structure, 1.0f);
+		roomObjects[4] = new MeshObject("Data/Meshes/room_wall4.obj", "Data/Meshes/room_wall4_collider.obj", "Data/Textures/omi_tapete.png", *meshStructure, 1.0f, meshPacking);
 		roomObjects[4]->collider[0]->trans(rooM);
-		roomObjects[5] = new MeshObject("Data/Meshes/room_ceiling.obj", "Data/Meshes/room_ceiling_collider.obj", "Data/Textures/ceilingTexture.png", structure, 1.0f);
+		roomObjects[5] = new MeshObject("Data/Meshes/room_ceiling.obj", "Data/Meshes/room_ceiling_collider.obj", "Data/Textures/ceilingTexture.png", *meshStructure, 1.0f, meshPacking);
 		roomObjects[5]->collider[0]->trans(rooM);
 		roomObjects[6] = nullptr;
 
         log(Info, "Load fridge");
-        fridgeBody = new MeshObject("Data/Meshes/fridge_body.obj", "Data/Meshes/fridge_body_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        fridgeDoorClosed = new MeshObject("Data/Meshes/fridge_door.obj", "Data/Meshes/fridge_door_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        fridgeDoorOpen = new MeshObject("Data/Meshes/fridge_door_open.obj", nullptr, "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
+        fridgeBody = new MeshObject("Data/Meshes/fridge_body.obj", "Data/Meshes/fridge_body_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        fridgeDoorClosed = new MeshObject("Data/Meshes/fridge_door.obj", "Data/Meshes/fridge_door_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        fridgeDoorOpen = new MeshObject("Data/Meshes/fridge_door_open.obj", nullptr, "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
         kitchenObjects[0] = new KitchenObject(fridgeBody, fridgeDoorClosed, fridgeDoorOpen, vec3(6.0f, 0.0f, 0.0f), vec3(-pi/2, 0.0f, 0.0f));
         
         fridgeTrigger = new TriggerCollider("Data/Meshes/fridge_trigger.obj", "Data/Textures/black.png", structure, kitchenObjects[0]->M);
@@ -640,30 +945,30 @@ namespace {
         //triggerCollider[0] = fridgeTrigger;
         
         log(Info, "Load cupboard and cake");
-        cupboard1 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        cake = new MeshObject("Data/Meshes/cake.obj", "Data/Meshes/cake_collider.obj", "Data/Textures/CakeTexture.png", structure, 1.0f);
+        cupboard1 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        cake = new MeshObject("Data/Meshes/cake.obj", "Data/Meshes/cake_collider.obj", "Data/Textures/CakeTexture.png", *meshStructure, 1.0f, meshPacking);
         kitchenObjects[1] = new KitchenObject(cupboard1, nullptr, nullptr, vec3(0.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
         kitchenObjects[2] = new KitchenObject(cake, nullptr, nullptr, vec3(0.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
         
         log(Info, "Load chair");
-		chair1 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", structure, 1.0f);
-		chair2 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", structure, 1.0f);
-		chair3 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", structure, 1.0f);
-		chair4 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", structure, 1.0f);
+		chair1 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", *meshStructure, 1.0f, meshPacking);
+		chair2 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", *meshStructure, 1.0f, meshPacking);
+		chair3 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", *meshStructure, 1.0f, meshPacking);
+		chair4 = new MeshObject("Data/Meshes/chair.obj", "Data/Meshes/chair_collider.obj", "Data/Textures/LightFurnitureTexture.png", *meshStructure, 1.0f, meshPacking);
 		kitchenObjects[3] = new KitchenObject(chair1, nullptr, nullptr, vec3(5.0f, 0.0f, 5.0f), vec3(0.0f, 0.0f, 0.0f));
         kitchenObjects[4] = new KitchenObject(chair2, nullptr, nullptr, vec3(5.0f, 0.0f, 8.0f), vec3(pi, 0.0f, 0.0f));
         kitchenObjects[5] = new KitchenObject(chair3, nullptr, nullptr, vec3(6.5f, 0.0f, 6.5f), vec3(-pi/2, 0.0f, 0.0f));
         kitchenObjects[6] = new KitchenObject(chair4, nullptr, nullptr, vec3(3.5f, 0.0f, 6.5f), vec3(pi/2, 0.0f, 0.0f));
         
         log(Info, "Load table");
-        table = new MeshObject("Data/Meshes/table.obj", "Data/Meshes/table_collider.obj", "Data/Textures/LightFurnitureTexture.png", structure, 1.0f);
+        table = new MeshObject("Data/Meshes/table.obj", "Data/Meshes/table_collider.obj", "Data/Textures/LightFurnitureTexture.png", *meshStructure, 1.0f, meshPacking);
         kitchenObjects[7] = new KitchenObject(table, nullptr, nullptr, vec3(5.0f, 0.0f, 6.5f), vec3(0.0f, 0.0f, 0.0f));
         
         log(Info, "Load oven");
-		ovenBody = new MeshObject("Data/Meshes/oven_body.obj", "Data/Meshes/oven_body_collider.obj", "Data/Textures/ovenTexture.png", structure, 1.0f);
-		ovenDoorClosed = new MeshObject("Data/Meshes/oven_door.obj", "Data/Meshes/oven_door_collider.obj", "Data/Textures/ovenTexture.png", structure, 1.0f);
-        ovenDoorOpen = new MeshObject("Data/Meshes/oven_door_open.obj", nullptr, "Data/Textures/ovenTexture.png", structure, 1.0f);
-        stove = new MeshObject("Data/Meshes/stove.obj", "Data/Meshes/stove_collider.obj", "Data/Textures/stoveTexture_off.png", structure, 1.0f);
+		ovenBody = new MeshObject("Data/Meshes/oven_body.obj", "Data/Meshes/oven_body_collider.obj", "Data/Textures/ovenTexture.png", *meshStructure, 1.0f, meshPacking);
+		ovenDoorClosed = new MeshObject("Data/Meshes/oven_door.obj", "Data/Meshes/oven_door_collider.obj", "Data/Textures/ovenTexture.png", *meshStructure, 1.0f, meshPacking);
+        ovenDoorOpen = new MeshObject("Data/Meshes/oven_door_open.obj", nullptr, "Data/Textures/ovenTexture.png", *meshStructure, 1.0f, meshPacking);
+        stove = new MeshObject("Data/Meshes/stove.obj", "Data/Meshes/stove_collider.obj", "Data/Textures/stoveTexture_off.png", *meshStructure, 1.0f, meshPacking);
         kitchenObjects[8] = new KitchenObject(ovenBody, ovenDoorClosed, ovenDoorOpen, vec3(2.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
 		kitchenObjects[9] = new KitchenObject(stove, nullptr, nullptr, vec3(2.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
         
@@ -676,10 +981,10 @@ namespace {
         //triggerCollider[2] = stoveTrigger;
 
         log(Info, "Load microwave");
-        microwaveBody = new MeshObject("Data/Meshes/microwave_body.obj", "Data/Meshes/microwave_body_collider.obj", "Data/Textures/microwaveTexture.png", structure, 1.0f);
-        microwaveDoorClosed = new MeshObject("Data/Meshes/microwave_door.obj", "Data/Meshes/microwave_door_collider.obj", "Data/Textures/microwaveTexture.png", structure, 1.0f);
-        microwaveDoorOpen = new MeshObject("Data/Meshes/microwave_door_open.obj", nullptr, "Data/Textures/microwaveTexture.png", structure, 1.0f);
-		cupboard2 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
+        microwaveBody = new MeshObject("Data/Meshes/microwave_body.obj", "Data/Meshes/microwave_body_collider.obj", "Data/Textures/microwaveTexture.png", *meshStructure, 1.0f, meshPacking);
+        microwaveDoorClosed = new MeshObject("Data/Meshes/microwave_door.obj", "Data/Meshes/microwave_door_collider.obj", "Data/Textures/microwaveTexture.png", *meshStructure, 1.0f, meshPacking);
+        microwaveDoorOpen = new MeshObject("Data/Meshes/microwave_door_open.obj", nullptr, "Data/Textures/microwaveTexture.png", *meshStructure, 1.0f, meshPacking);
+		cupboard2 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
 		kitchenObjects[10] = new KitchenObject(microwaveBody, microwaveDoorClosed, microwaveDoorOpen, vec3(4.0f, 1.4f, 0.0f), vec3(-pi/2, 0.0f, 0.0f));
         kitchenObjects[11] = new KitchenObject(cupboard2, nullptr, nullptr, vec3(4.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
         
@@ -688,7 +993,7 @@ namespace {
         //triggerCollider[3] = microwaveTrigger;
         
         log(Info, "Load wash");
-        wash = new MeshObject("Data/Meshes/wash.obj", "Data/Meshes/wash_collider.obj", "Data/Textures/white.png", structure, 1.0f);
+        wash = new MeshObject("Data/Meshes/wash.obj", "Data/Meshes/wash_collider.obj", "Data/Textures/white.png", *meshStructure, 1.0f, meshPacking);
         kitchenObjects[12] = new KitchenObject(wash, nullptr, nullptr, vec3(-2.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
         
         washTrigger = new TriggerCollider("Data/Meshes/wash_trigger.obj", "Data/Textures/black.png", structure, kitchenObjects[12]->M);
@@ -696,33 +1001,96 @@ namespace {
         //triggerCollider[4] = washTrigger;
         
         log(Info, "Load cupboard");
-		cupboard3 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
+		cupboard3 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
 		kitchenObjects[13] = new KitchenObject(cupboard3, nullptr, nullptr, vec3(-4.0f, 0.0f, 0.0f), vec3(pi, 0.0f, 0.0f));
         
-        cupboard4 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        cupboard5 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        cupboard6 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        cupboard7 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
-        cupboard8 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", structure, 1.0f);
+        cupboard4 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        cupboard5 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        cupboard6 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        cupboard7 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
+        cupboard8 = new MeshObject("Data/Meshes/cupboard.obj", "Data/Meshes/cupboard_collider.obj", "Data/Textures/fridgeAndCupboardTexture.png", *meshStructure, 1.0f, meshPacking);
         kitchenObjects[14] = new KitchenObject(cupboard4, nullptr, nullptr, vec3(4.0f, 0.0f, 13.5f), vec3(0.0f, 0.0f, 0.0f));
         kitchenObjects[15] = new KitchenObject(cupboard5, nullptr, nullptr, vec3(2.0f, 0.0f, 13.5f), vec3(0.0f, 0.0f, 0.0f));
         kitchenObjects[16] = new KitchenObject(cupboard6, nullptr, nullptr, vec3(0.0f, 0.0f, 13.5f), vec3(0.0f, 0.0f, 0.0f));
         kitchenObjects[17] = new KitchenObject(cupboard7, nullptr, nullptr, vec3(-2.0f, 0.0f, 13.5f), vec3(0.0f, 0.0f, 0.0f));
         kitchenObjects[18] = new KitchenObject(cupboard8, nullptr, nullptr, vec3(-4.0f, 0.0f, 13.5f), vec3(0.0f, 0.0f, 0.0f));
 		
-		MeshObject* img = new MeshObject("Data/Meshes/credits.obj", nullptr, "Data/Textures/creditsTexture.png", structure, 1.0f);
+		MeshObject* img = new MeshObject("Data/Meshes/credits.obj", nullptr, "Data/Textures/creditsTexture.png", *meshStructure, 1.0f, meshPacking);
 		kitchenObjects[19] = new KitchenObject(img, nullptr, nullptr, vec3(-7.95f, 5.0f, 7.0f), vec3(-pi * 0.5f, 0.0f, 0.0f));
 		
-		MeshObject* lamp = new MeshObject("Data/Meshes/lamp.obj", nullptr, "Data/Textures/lampTexture.png", structure, 1.0f);
+		MeshObject* lamp = new MeshObject("Data/Meshes/lamp.obj", nullptr, "Data/Textures/lampTexture.png", *meshStructure, 1.0f, meshPacking);
 		kitchenObjects[20] = new KitchenObject(lamp, nullptr, nullptr, vec3(0.0f, 9.0f, 7.0f), vec3(0.0f, 0.0f, 0.0f));
 
 		kitchenObjects[21] = nullptr;
 
+		kitchenAtlas = new TextureAtlas();
+		for (unsigned oi = 0; kitchenObjects[oi] != nullptr; ++oi) {
+			if (kitchenObjects[oi]->pizza || kitchenObjects[oi]->body == nullptr) continue;
+			kitchenAtlas->add(kitchenObjects[oi]->body->textureFile, kitchenObjects[oi]->body->image);
+		}
+		kitchenAtlas->build();
+
+		kitchenBatch = new StaticBatch(structure, kitchenAtlas);
+		// the cupboards and chairs
+		kitchenBatch->instance(structures, staticInstancedProgram, staticInstancedTex);
+		for (unsigned oi = 0; kitchenObjects[oi] != nullptr; ++oi) {
+			if (kitchenObjects[oi]->pizza || kitchenObjects[oi]->body == nullptr) continue;
+			kitchenBatch->add(kitchenObjects[oi]->body, kitchenObjects[oi]->M);
+			kitchenObjects[oi]->batched = true;
+		}
+		kitchenBatch->build();
+
+		roomBatch = new StaticBatch(structure);
+		for (unsigned oi = 0; roomObjects[oi] != nullptr; ++oi) {
+			roomBatch->add(roomObjects[oi], rooM);
+		}
+		roomBatch->build();
+
+		// All pizzas are loaded up front, placing one only moves and shows it
+		for (int i = 0; i < maxPizza; ++i) {
+			MeshObject* pizza = new MeshObject("Data/Meshes/pizza.obj", "Data/Meshes/pizza_collider.obj", "Data/Textures/pizza.png", *meshStructure, 1.0f, meshPacking);
+			kitchenObjects[PIZZA_OFFSET + i] = new KitchenObject(pizza, nullptr, nullptr, vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f), true);
+			kitchenObjects[PIZZA_OFFSET + i]->visible = false;
+		}
+		kitchenObjects[PIZZA_OFFSET + maxPizza] = nullptr;
+		for (unsigned oi = 0; kitchenObjects[oi] != nullptr; ++oi) {
+			kitchenObjects[oi]->buildLods();
+		}
+
 		hovered = nullptr;
 
+		occlusion = new OcclusionBuffer(width / 8, height / 8);
+
+		renderQueue = new RenderQueue;
+		renderQueue->addProgram(program, [](CommandBuffer& commands) {
+			commands.setMatrix(pLocation, P);
+			commands.setMatrix(vLocation, View);
+			// the room tiles its textures
+			commands.setTextureAddressing(tex, U, Repeat);
+			commands.setTextureAddressing(tex, V, Repeat);
+		});
+		renderQueue->addProgram(instancedProgram, [](CommandBuffer& commands) {
+			commands.setMatrix(instancedPLocation, P);
+			commands.setMatrix(instancedVLocation, View);
+		});
+		renderQueue->addProgram(staticInstancedProgram, [](CommandBuffer& commands) {
+			commands.setMatrix(staticInstancedPLocation, P);
+			commands.setMatrix(staticInstancedVLocation, View);
+		});
+		if (packedVertices) {
+			renderQueue->addProgram(packedProgram, [](CommandBuffer& commands) {
+				commands.setMatrix(packedPLocation, P);
+				commands.setMatrix(packedVLocation, View);
+			});
+			renderQueue->addProgram(packedInstancedProgram, [](CommandBuffer& commands) {
+				commands.setMatrix(packedInstancedPLocation, P);
+				commands.setMatrix(packedInstancedVLocation, View);
+			});
+		}
+
         Random::init(System::time() * 100);
         
-        Ant::init();
+        Ant::init(packedVertices ? &packedInstancedLocations : nullptr);
         
         Graphics::setRenderState(DepthTest, true);
         Graphics::setRenderState(DepthTestCompare, ZCompareLess);
@@ -732,16 +1100,58 @@ namespace {
         
         P = mat4::Perspective(45, (float)width / (float)height, 0.1f, 1000);
         
+#ifndef NULL_GRAPHICS
 		g2 = new Graphics2(width, height);
 
         font14 = Kravur::load("Data/Fonts/arial", FontStyle(), 14);
         font24 = Kravur::load("Data/Fonts/arial", FontStyle(), 24);
         font34 = Kravur::load("Data/Fonts/arial", FontStyle(), 34);
         font44 = Kravur::load("Data/Fonts/arial", FontStyle(), 44);
+#endif
     }
 }
 
+#ifdef NULL_GRAPHICS
+// No window, input or audio, runs as many frames as asked for and logs what they cost.
+// --selftest only checks the fast paths against their reference versions, --benchmark times them.
 int kore(int argc, char** argv) {
+	int frames = 1000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--selftest") == 0) return runSelfTests() ? 0 : 1;
+		if (strcmp(argv[i], "--benchmark") == 0) return runBenchmarks() ? 0 : 1;
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[i + 1]);
+		if (strcmp(argv[i], "--pipelined") == 0) pipelined = true;
+		if (strcmp(argv[i], "--bake-textures") == 0) setTextureBaking(true);
+		if (strcmp(argv[i], "--packed-vertices") == 0) packedVertices = true;
+	}
+
+	init();
+
+	startTime = System::time();
+	startSimulation();
+	for (int i = 0; i < frames; ++i) {
+		update();
+	}
+	stopSimulation();
+	double seconds = System::time() - startTime;
+
+	const NullGraphics::Stats& stats = NullGraphics::stats;
+	log(Info, "%i frames in %f s, %f ms per frame%s", frames, seconds, seconds * 1000.0 / frames, pipelined ? ", pipelined" : "");
+	log(Info, "Last frame: %i draws, %i instances, %i triangles, %i texture and %i program switches, %i constants, %i bytes locked",
+		stats.drawCalls, stats.instances, stats.triangles, stats.textureSwitches, stats.programSwitches, stats.constants, stats.bytesLocked);
+
+	return 0;
+}
+#else
+int kore(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--pipelined") == 0) pipelined = true;
+		// Writes a .ktex next to every png that gets loaded, later starts skip decoding them
+		if (strcmp(argv[i], "--bake-textures") == 0) setTextureBaking(true);
+		// Quantized positions, uvs and normals for the kitchen meshes and ants
+		if (strcmp(argv[i], "--packed-vertices") == 0) packedVertices = true;
+	}
+
     Kore::System::setName(title);
 	Kore::System::setup();
 
@@ -776,7 +1186,10 @@ int kore(int argc, char** argv) {
 
 	Mouse::the()->lock(0);
 
+	startSimulation();
 	Kore::System::start();
+	stopSimulation();
 
 	return 0;
 }
+#endif
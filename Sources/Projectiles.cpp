@@ -43,7 +43,8 @@ Projectiles::Projectiles(int maxProjectiles, float hitDistance, Texture* particl
 	
 	vertexBuffers = new VertexBuffer*[2];
 	vertexBuffers[0] = mesh->vertexBuffers[0];
-	vertexBuffers[1] = new VertexBuffer(maxProjectiles, *structures[1], 1);
+	vertexBuffers[1] = nullptr;
+	instances = new InstanceBufferRing(*structures[1], maxProjectiles, 1);
 }
 
 namespace {
@@ -167,7 +168,8 @@ void Projectiles::onShooterDeath(int projectileID) {
 }
 
 void Projectiles::render(ConstantLocation vLocation, TextureUnit tex, mat4 view) {
-	float* data = vertexBuffers[1]->lock();
+	float* data = instances->lock();
+	vertexBuffers[1] = instances->current();
 	int c = 0;
 	for (int i = 0; i < maxProj; i++) {
 		if (physicsObject[i]->active) {
@@ -178,7 +180,7 @@ void Projectiles::render(ConstantLocation vLocation, TextureUnit tex, mat4 view)
 			c++;
 		}
 	}
-	vertexBuffers[1]->unlock();
+	instances->unlock();
 	
 	Graphics::setTexture(tex, sharedMesh->image);
 	Graphics::setVertexBuffers(vertexBuffers, 2);
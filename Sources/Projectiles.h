@@ -2,6 +2,7 @@
 
 #include <set>
 
+#include "Engine/InstanceBufferRing.h"
 #include "Engine/Particles.h"
 #include "Engine/PhysicsObject.h"
 #include "Engine/PhysicsWorld.h"
@@ -31,6 +32,7 @@ private:
 	float hitDist;
 	MeshObject* sharedMesh;
 	Kore::VertexBuffer** vertexBuffers;
+	InstanceBufferRing* instances;
 
 	// Projectiles
 	float* timeToLife;
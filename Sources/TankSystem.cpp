@@ -1,5 +1,6 @@
 #include "Kore/pch.h"
 #include "TankSystem.h"
+#include "Engine/TextureLoader.h"
 
 TankSystem::TankSystem(PhysicsWorld* world, ParticleRenderer* particleRenderer, InstancedMeshObject* meshB, InstancedMeshObject* meshT, InstancedMeshObject* meshF, vec3 spawn1a, vec3 spawn1b, vec3 spawn2a, vec3 spawn2b, float delay, Projectiles* projectiles, VertexStructure** structures, Ground* grnd) :
 		meshBottom(meshB),
@@ -16,8 +17,8 @@ TankSystem::TankSystem(PhysicsWorld* world, ParticleRenderer* particleRenderer,
 		ground(grnd) {
 	tanks.reserve(MAX_TANKS);
 	spawnTimer = spawnDelay;
-    particleTexture = new Texture("Data/Textures/particle.png", true);
-	texture = new Texture("Data/Textures/white.png", true);
+    particleTexture = loadTexture("Data/Textures/particle.png", true);
+	texture = loadTexture("Data/Textures/white.png", true);
 	hoveredTank = nullptr;
 
 	destroyed = 0;
@@ -37,7 +38,8 @@ void TankSystem::initBars(vec2 halfSize, VertexStructure** structures) {
 	setVertex(vertices, 3, 1 * halfSize.x(), -1 * halfSize.y(), 0, 1, 0);
 	vbs[0]->unlock();
 
-	vbs[1] = new VertexBuffer(MAX_TANKS * 4, *structures[1], 1);
+	barInstances = new InstanceBufferRing(*structures[1], MAX_TANKS * 4, 1);
+	vbs[1] = nullptr;
 
 	// Set index buffer
 	ib = new IndexBuffer(6);
@@ -187,10 +189,11 @@ mat4 getRotM(vec3 ax, float an) {
 }
 
 void TankSystem::render(TextureUnit tex, mat4 View, ConstantLocation vLocation) {
-	float* dataB = meshBottom->vertexBuffers[1]->lock();
-	float* dataT = meshTop->vertexBuffers[1]->lock();
-	float* dataF = meshFlag->vertexBuffers[1]->lock();
-	float* dataBars = vbs[1]->lock();
+	float* dataB = meshBottom->lockInstances();
+	float* dataT = meshTop->lockInstances();
+	float* dataF = meshFlag->lockInstances();
+	float* dataBars = barInstances->lock();
+	vbs[1] = barInstances->current();
 
 	mat4 modView = View.Invert();
 	modView.Set(0, 3, 0.0f);
@@ -263,10 +266,10 @@ void TankSystem::render(TextureUnit tex, mat4 View, ConstantLocation vLocation)
         }
 	}
 
-	meshBottom->vertexBuffers[1]->unlock();
-	meshTop->vertexBuffers[1]->unlock();
-	meshFlag->vertexBuffers[1]->unlock();
-	vbs[1]->unlock();
+	meshBottom->unlockInstances();
+	meshTop->unlockInstances();
+	meshFlag->unlockInstances();
+	barInstances->unlock();
 
 	meshBottom->render(tex, j);
 	meshTop->render(tex, j);
@@ -7,6 +7,7 @@
 
 #include "Tank.h"
 #include "Engine/InstancedMeshObject.h"
+#include "Engine/InstanceBufferRing.h"
 #include "Engine/Explosion.h"
 #include "ParticleRenderer.h"
 #include "Ground.h"
@@ -55,6 +56,7 @@ private:
 	Ground* ground;
 
 	Kore::VertexBuffer** vbs;
+	InstanceBufferRing* barInstances;
 	Kore::IndexBuffer* ib;
 	Kore::Texture* texture;
 };
@@ -0,0 +1,40 @@
+uniform mat4 P;
+uniform mat4 V;
+uniform vec3 lightPos;
+uniform sampler2D animation;
+uniform vec3 boundsMin;
+uniform vec3 boundsSize;
+uniform float frames;
+uniform float rows;
+uniform float texelHeight;
+
+attribute vec2 vid;
+attribute vec2 tex;
+
+attribute mat4 M;
+attribute mat4 N;
+attribute vec4 tint;
+attribute float phase;
+
+varying vec2 texCoord;
+varying vec3 normal;
+varying vec3 lightDirection;
+varying vec3 eyeCoord;
+varying vec4 tintCol;
+
+void kore() {
+	// the positions of all frames come first, then the normals
+	float frame = min(floor(phase * frames), frames - 1.0);
+	float row = frame * rows + vid.y;
+	vec3 pos = boundsMin + texture2DLod(animation, vec2(vid.x, (row + 0.5) * texelHeight), 0.0).xyz * boundsSize;
+	vec3 nor = texture2DLod(animation, vec2(vid.x, (frames * rows + row + 0.5) * texelHeight), 0.0).xyz * 2.0 - 1.0;
+
+	eyeCoord = (V * M * vec4(pos, 1.0)).xyz;
+	vec3 transformedLightPos = (V * M * vec4(lightPos, 1.0)).xyz;
+	lightDirection = transformedLightPos - eyeCoord;
+	
+	gl_Position = P * vec4(eyeCoord.x, eyeCoord.y, eyeCoord.z, 1.0);
+	texCoord = tex;
+	normal = (N * vec4(nor, 0.0)).xyz;
+	tintCol = tint;
+}
\ No newline at end of file
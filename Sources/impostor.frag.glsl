@@ -0,0 +1,13 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+uniform sampler2D tex;
+
+varying vec2 texCoord;
+varying vec4 tintCol;
+
+// Impostor atlases have their shading baked in, the tint's alpha fades them
+void kore() {
+	gl_FragColor = texture2D(tex, texCoord) * tintCol;
+}
@@ -0,0 +1,31 @@
+attribute vec4 pos;
+attribute vec4 texnor;
+
+varying vec3 position;
+varying vec2 texCoord;
+varying vec3 normal;
+
+uniform mat4 P;
+uniform mat4 V;
+uniform mat4 M;
+uniform vec3 posOffset;
+uniform vec3 posScale;
+uniform vec4 uvTransform;
+
+// Unfolds a normal from the octahedral encoding of PackedVertices.cpp
+vec3 octahedral(vec2 e) {
+	vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(n.yx)) * signs;
+	}
+	return normalize(n);
+}
+
+void kore() {
+	vec4 newPos = M * vec4(posOffset + pos.xyz * posScale, 1.0);
+	gl_Position = P * V * newPos;
+	position = newPos.xyz / newPos.w;
+	texCoord = uvTransform.xy + texnor.xy * uvTransform.zw;
+	normal = (V * M * vec4(octahedral(texnor.zw), 0.0)).xyz;
+}
@@ -0,0 +1,40 @@
+uniform mat4 P;
+uniform mat4 V;
+uniform vec3 lightPos;
+uniform vec3 posOffset;
+uniform vec3 posScale;
+uniform vec4 uvTransform;
+
+attribute vec4 pos;
+attribute vec4 texnor;
+
+attribute mat4 M;
+attribute mat4 N;
+attribute vec4 tint;
+
+varying vec2 texCoord;
+varying vec3 normal;
+varying vec3 lightDirection;
+varying vec3 eyeCoord;
+varying vec4 tintCol;
+
+// Unfolds a normal from the octahedral encoding of PackedVertices.cpp
+vec3 octahedral(vec2 e) {
+	vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(n.yx)) * signs;
+	}
+	return normalize(n);
+}
+
+void kore() {
+	eyeCoord = (V * M * vec4(posOffset + pos.xyz * posScale, 1.0)).xyz;
+	vec3 transformedLightPos = (V * M * vec4(lightPos, 1.0)).xyz;
+	lightDirection = transformedLightPos - eyeCoord;
+	
+	gl_Position = P * vec4(eyeCoord.x, eyeCoord.y, eyeCoord.z, 1.0);
+	texCoord = uvTransform.xy + texnor.xy * uvTransform.zw;
+	normal = (N * vec4(octahedral(texnor.zw), 0.0)).xyz;
+	tintCol = tint;
+}
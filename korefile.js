@@ -4,6 +4,11 @@ project.addFile('Sources/**');
 project.setDebugDir('Deployment');
 project.cpp11 = true;
 
+// Headless build for timing frames, Kore has to be created without a graphics backend
+if (process.env.NULL_GRAPHICS) {
+	project.addDefine('NULL_GRAPHICS');
+}
+
 Project.createProject('Kore', __dirname).then((subproject) => {
 	project.addSubProject(subproject);
 	resolve(project);